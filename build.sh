@@ -0,0 +1,135 @@
+#!/bin/sh
+# Build script for Toledo Atomchess Reloaded on Linux and other POSIX hosts
+# UNIVAC build with POSIX threads, optimized with profile-guided
+# optimization (PGO) trained on the bench workload plus link-time
+# optimization (LTO)
+#
+# Usage: ./build.sh [bench depth]     (environment: CC, BENCH_DEPTH, RUNS)
+
+set -e
+cd "$(dirname "$0")"
+
+CC=${CC:-gcc}
+BENCH_DEPTH=${1:-${BENCH_DEPTH:-7}}
+RUNS=${RUNS:-3}
+
+echo
+echo "========================================"
+echo "  Toledo Atomchess Reloaded - Linux Build"
+echo "========================================"
+echo
+
+if ! command -v "$CC" >/dev/null 2>&1; then
+    echo "ERROR: $CC not found in PATH"
+    exit 1
+fi
+echo "Compiler: $CC"
+"$CC" --version | head -n 1
+echo
+
+# ============================================================================
+# FLAGS
+# ============================================================================
+# -DUNIVAC -DPOSIX : Console-free UNIVAC code path with pthreads, monotonic
+#                    clock, mmap and shared memory
+# -O3              : Baseline optimization level (the reference build)
+# -flto=auto       : Link-Time Optimization (parallel LTRANS jobs)
+# -fprofile-generate / -fprofile-use : PGO instrumented and final builds
+# -fprofile-update=atomic : Exact counters with -threads during training
+# ============================================================================
+
+PLATFORM_FLAGS="-DUNIVAC -DPOSIX -pthread"
+WARNING_FLAGS="-Wall -Wextra -Wno-unused-parameter"
+BASE_FLAGS="-O3 -DNDEBUG -pipe"
+PROFILE_DIR=pgo_profile
+
+BASELINE=toledo_atomchess_o3
+OUTPUT=toledo_atomchess_linux
+
+# Best nodes/second of RUNS bench runs, and the node signature
+run_bench() {
+    best=0
+    signature=
+    run=0
+    while [ "$run" -lt "$RUNS" ]; do
+        output=$(./"$1" bench "$BENCH_DEPTH")
+        nodes=$(echo "$output" | sed -n 's/^Nodes searched *: *//p')
+        nps=$(echo "$output" | sed -n 's/^Nodes\/second *: *//p')
+        if [ -n "$signature" ] && [ "$nodes" != "$signature" ]; then
+            echo "ERROR: $1 bench is not deterministic ($signature, then $nodes nodes)" >&2
+            exit 1
+        fi
+        signature=$nodes
+        if [ "$nps" -gt "$best" ]; then
+            best=$nps
+        fi
+        run=$((run + 1))
+    done
+    echo "$signature $best"
+}
+
+# ============================================================================
+# STEP 1: BASELINE -O3 BUILD
+# ============================================================================
+echo "Building baseline ($BASE_FLAGS)..."
+rm -f "$BASELINE" "$OUTPUT"
+"$CC" $WARNING_FLAGS $BASE_FLAGS $PLATFORM_FLAGS -o "$BASELINE" toledo_atomchess.c
+
+# ============================================================================
+# STEP 2: INSTRUMENTED BUILD AND TRAINING RUN
+# ============================================================================
+# Both stages compile to the same object name: profile data is keyed by it
+echo "Building instrumented binary..."
+rm -rf "$PROFILE_DIR"
+"$CC" $WARNING_FLAGS $BASE_FLAGS $PLATFORM_FLAGS -flto=auto \
+    -fprofile-generate -fprofile-update=atomic -fprofile-dir="$PROFILE_DIR" \
+    -c -o toledo_atomchess_pgo.o toledo_atomchess.c
+"$CC" $BASE_FLAGS -pthread -flto=auto -fprofile-generate \
+    -o toledo_atomchess_instrumented toledo_atomchess_pgo.o
+
+echo "Training on bench $BENCH_DEPTH..."
+./toledo_atomchess_instrumented bench "$BENCH_DEPTH" >/dev/null
+rm -f toledo_atomchess_instrumented
+
+# ============================================================================
+# STEP 3: OPTIMIZED BUILD WITH PROFILE DATA AND LTO
+# ============================================================================
+echo "Building with profile data and LTO..."
+"$CC" $WARNING_FLAGS $BASE_FLAGS $PLATFORM_FLAGS -flto=auto -Werror=missing-profile \
+    -fprofile-use -fprofile-correction -fprofile-dir="$PROFILE_DIR" \
+    -c -o toledo_atomchess_pgo.o toledo_atomchess.c
+"$CC" $BASE_FLAGS -pthread -flto=auto -o "$OUTPUT" toledo_atomchess_pgo.o
+rm -f toledo_atomchess_pgo.o
+
+# ============================================================================
+# STEP 4: VERIFY THE BENCH SIGNATURE AND MEASURE THE GAIN
+# ============================================================================
+echo "Comparing bench $BENCH_DEPTH (best of $RUNS runs)..."
+set -- $(run_bench "$BASELINE")
+base_nodes=$1
+base_nps=$2
+set -- $(run_bench "$OUTPUT")
+pgo_nodes=$1
+pgo_nps=$2
+
+echo
+echo "Baseline -O3 : $base_nodes nodes, $base_nps nodes/second"
+echo "PGO + LTO    : $pgo_nodes nodes, $pgo_nps nodes/second"
+
+if [ "$base_nodes" != "$pgo_nodes" ]; then
+    echo
+    echo "========================================"
+    echo "  BUILD FAILED - bench signature changed"
+    echo "========================================"
+    exit 1
+fi
+
+echo "NPS gain     : $(awk "BEGIN { printf \"%+.1f%%\", ($pgo_nps - $base_nps) * 100.0 / $base_nps }")"
+echo
+echo "========================================"
+echo "  BUILD SUCCESSFUL"
+echo "========================================"
+echo
+echo "Output: $OUTPUT (baseline: $BASELINE)"
+echo "To play chess, type: ./$OUTPUT"
+echo
@@ -67,6 +67,25 @@ const unsigned char offsets[7] = {
     8   // King
 };
 
+// Transposition table shared by all searches
+TranspositionTable tt;
+
+// Lazy SMP helper search states (threads - 1 of them)
+ChessState* helper_states;
+int helper_count;
+
+// Zobrist keys indexed by piece (color + type) and 0x88 square
+unsigned long long zobrist_keys[16][BOARD_SIZE];
+unsigned long long zobrist_side;
+
+// Board scan kernel picked by select_kernel()
+piece_mask_func piece_mask = piece_mask_scalar;
+int kernel_variant = KERNEL_SCALAR;
+const char* const kernel_names[KERNEL_COUNT] = {"scalar", "sse2", "avx2"};
+
+// Asynchronous log (NULL when logging is off)
+AsyncLog* async_log = NULL;
+
 // Platform-specific console setup
 #ifndef UNIVAC
 void console_setup(void) {
@@ -84,12 +103,12 @@ unsigned char get_random_byte(ChessState* state) {
 }
 
 // Main entry point
-int main(void) {
+int main(int argc, char** argv) {
 #ifndef UNIVAC
     console_setup();
 #endif
 
-    ChessState state;
+    static ChessState state;
 
     // Initialize BSS (zero out all state)
     memset(&state, 0, sizeof(ChessState));
@@ -97,9 +116,115 @@ int main(void) {
     // Initialize random seed
     state.rand_seed = (unsigned int)time(NULL);
 
-    init_chess(&state);
-    run_game(&state);
+    init_zobrist();
+    init_search_params(&state);
+    int arg = parse_options(&state, argc, argv);
+    if (!select_kernel(state.cpu_kernel)) {
+        printf("CPU kernel %s not available, using %s\n", state.cpu_kernel, kernel_names[kernel_variant]);
+    }
+
+    unsigned long long memory_used = apply_memory_budget(&state, state.memory_kb);
+    if (memory_used == 0) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    report_memory(&state, memory_used);
+
+    if (state.tt_load_file && !tt_load(state.tt_load_file, state.tt_mmap)) {
+        printf("Cannot load hash table %s\n", state.tt_load_file);
+    }
+    if (state.log_file && !log_open(state.log_file)) {
+        printf("Cannot open log %s\n", state.log_file);
+    }
+    if (state.tree_file && !(state.tree_dump = tree_open(state.tree_file))) {
+        printf("Cannot open tree dump %s\n", state.tree_file);
+    }
+
+    if (arg < argc && strcmp(argv[arg], "bench") == 0) {
+        // "bench [depth]" runs the fixed benchmark positions instead of a game
+        run_bench(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "scaling") == 0) {
+        // "scaling [threads] [depth] [repeats]" prints thread scaling as CSV
+        run_scaling(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0,
+                    arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                    arg + 3 < argc ? atoi(argv[arg + 3]) : 0);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "annotate") == 0) {
+        // "annotate <file.pgn> [depth] [forward]" annotates every game in a PGN file
+        run_annotate(&state, argv[arg + 1], arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                     !(arg + 3 < argc && strcmp(argv[arg + 3], "forward") == 0));
+    } else if (arg + 1 < argc && strcmp(argv[arg], "deep") == 0) {
+        // "deep <checkpoint> [depth] [fen]" searches deep, checkpointing to resume
+        run_deep_search(&state, argv[arg + 1], arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                        arg + 3 < argc ? argv[arg + 3] : NULL);
+    } else if (arg < argc && strcmp(argv[arg], "records") == 0) {
+        // "records [games|file] [archive]" benchmarks compact game records
+        run_records(&state, arg + 1 < argc ? argv[arg + 1] : NULL, arg + 2 < argc ? argv[arg + 2] : NULL);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "suite") == 0) {
+        // "suite <file.epd> [ms] [nodes]" measures solve rate against time
+        run_suite(&state, argv[arg + 1], arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                  arg + 3 < argc ? strtoull(argv[arg + 3], NULL, 10) : 0);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "perft") == 0) {
+        // "perft <depth> [split ply] [dir]" counts leaf nodes, out of core when split
+        run_perft(&state, atoi(argv[arg + 1]), arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                  arg + 3 < argc ? argv[arg + 3] : ".");
+    } else if (arg < argc && strcmp(argv[arg], "sched") == 0) {
+        // "sched [sessions] [seconds] [depth]" runs searches under synthetic server load
+        run_sched(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0, arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                  arg + 3 < argc ? atoi(argv[arg + 3]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "broadcast") == 0) {
+        // "broadcast [spectators] [updates]" benchmarks fan-out to local sockets
+        run_broadcast(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0, arg + 2 < argc ? atoi(argv[arg + 2]) : 0);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "serve") == 0) {
+        // "serve <port> [games] [depth]" streams self-play games to TCP spectators
+        run_serve(&state, atoi(argv[arg + 1]), arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                  arg + 3 < argc ? atoi(argv[arg + 3]) : 0);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "tree") == 0) {
+        // "tree <file>" analyzes a search tree written with -tree
+        run_tree(argv[arg + 1]);
+    } else if (arg < argc && strcmp(argv[arg], "params") == 0) {
+        // "params" lists the runtime parameter table
+        list_search_params(&state);
+    } else if (arg + 1 < argc && strcmp(argv[arg], "spsa") == 0) {
+        // "spsa <state-file> [iterations] [pairs]" tunes the parameters by self-play
+        run_spsa(&state, argv[arg + 1], arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                 arg + 3 < argc ? atoi(argv[arg + 3]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "skill") == 0) {
+        // "skill [games]" measures the cost and strength of each skill level
+        run_skill(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "deadline") == 0) {
+        // "deadline [ms] [depth] [positions]" measures how late replies are against a deadline
+        run_deadline(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0, arg + 2 < argc ? atoi(argv[arg + 2]) : 0,
+                     arg + 3 < argc ? atoi(argv[arg + 3]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "attacks") == 0) {
+        // "attacks [depth] [verify]" compares incremental attack maps with recomputation
+        run_attacks(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0,
+                    arg + 2 < argc && strcmp(argv[arg + 2], "verify") == 0);
+    } else if (arg < argc && strcmp(argv[arg], "replay") == 0) {
+        // "replay [script|-] [depth]" plays scripted games without the console
+        run_replay(&state, arg + 1 < argc ? argv[arg + 1] : "-", arg + 2 < argc ? atoi(argv[arg + 2]) : 0);
+    } else if (arg < argc && strcmp(argv[arg], "analyze") == 0) {
+        // "analyze" reads moves and takebacks from stdin while searching
+        run_analysis(&state);
+    } else if (arg < argc && strcmp(argv[arg], "processes") == 0) {
+        // "processes [count] [depth]" benchmarks processes sharing one table
+        run_process_scaling(&state, arg + 1 < argc ? atoi(argv[arg + 1]) : 0,
+                            arg + 2 < argc ? atoi(argv[arg + 2]) : 0);
+    } else {
+        init_chess(&state);
+        run_game(&state);
+    }
+
+    if (state.tt_save_file && !tt_save(state.tt_save_file)) {
+        printf("Cannot save hash table %s\n", state.tt_save_file);
+    }
 
+    log_close();
+    if (state.tree_dump) {
+        printf("Tree: %llu nodes written to %s\n", state.tree_dump->records, state.tree_file);
+        tree_close(state.tree_dump);
+    }
+    free_search_tables(&state);
+    tt_free();
     return 0;
 }
 
@@ -147,35 +272,94 @@ void setup_board(ChessState* state) {
     }
 }
 
-// Display the board (lines 273-288)
-void display_board(const ChessState* state) {
-    // Display column labels (uppercase for teletype)
-    printf("    A   B   C   D   E   F   G   H\n\n");
+// Load a position from FEN (board, side to move and en passant square)
+// Returns the side to move, or -1 if the string is malformed
+int load_fen(ChessState* state, const char* fen) {
+    static const char piece_letters[] = " prbqnk";
+    int row = 0;
+    int col = 0;
+
+    create_board(state);
+    state->enp = 0;
+
+    for (; *fen && *fen != ' '; fen++) {
+        if (*fen == '/') {
+            row++;
+            col = 0;
+        } else if (*fen >= '1' && *fen <= '8') {
+            col += *fen - '0';
+        } else {
+            const char* p = strchr(piece_letters, tolower((unsigned char)*fen));
+            if (p == NULL || *p == ' ' || row > 7 || col > 7) {
+                return -1;
+            }
+            // Pieces are stored with the "unmoved" flag like setup_board()
+            state->board[row * 16 + col] = (unsigned char)((p - piece_letters)
+                | (isupper((unsigned char)*fen) ? WHITE : BLACK) | MOVED_MASK);
+            col++;
+        }
+    }
+
+    while (*fen == ' ') fen++;
+    int color = (*fen == 'b') ? BLACK : WHITE;
+
+    // Skip side and castling fields, then read the en passant target
+    for (int field = 0; field < 2 && *fen; field++) {
+        while (*fen && *fen != ' ') fen++;
+        while (*fen == ' ') fen++;
+    }
+    if (fen[0] >= 'a' && fen[0] <= 'h' && fen[1] >= '1' && fen[1] <= '8') {
+        int ep_square = (8 - (fen[1] - '0')) * 16 + (fen[0] - 'a');
+        // state->enp holds the square of the pawn that just advanced two squares
+        state->enp = (color == WHITE) ? ep_square + 16 : ep_square - 16;
+    }
+
+    return color;
+}
+
+// Board text as display_board() shows it; returns its length (lines 273-288)
+int format_board(const unsigned char* board, char* out) {
+    char* p = out;
 
-    // Display 8 rows of 8 squares each
+    // Column labels (uppercase for teletype)
+    memcpy(p, "    A   B   C   D   E   F   G   H\n\n", 35);
+    p += 35;
+
+    // 8 rows of 8 squares each
     for (int row = 0; row < 8; row++) {
         int row_base = row * 16;  // 0x88 board: each row is 16 bytes apart
         int rank = 8 - row;       // Chess rank (8 to 1)
 
-        // Display rank number
-        printf("%d  ", rank);
+        // Rank number
+        *p++ = (char)('0' + rank);
+        *p++ = ' ';
+        *p++ = ' ';
 
         for (int col = 0; col < 8; col++) {
             int pos = row_base + col;
-            unsigned char piece = state->board[pos] & PIECE_FULL_MASK;  // Remove "moved" bit
-            printf("%s", display_chars[piece]);
+            unsigned char piece = board[pos] & PIECE_FULL_MASK;  // Remove "moved" bit
+            *p++ = display_chars[piece][0];
+            *p++ = display_chars[piece][1];
 
-            // Add spacing between pieces (but not after the last piece)
+            // Spacing between pieces (but not after the last piece)
             if (col < 7) {
-                printf("  ");
+                *p++ = ' ';
+                *p++ = ' ';
             }
         }
-
-        printf("\n");
+        *p++ = '\n';
     }
+    *p = '\0';
+    return (int)(p - out);
+}
+
+// Display the board
+void display_board(const ChessState* state) {
+    char text[BOARD_TEXT_BYTES];
+    format_board(state->board, text);
+    fputs(text, stdout);
 }
 
-// Display a single character (lines 405-412)
 void display_char(char c) {
 #ifdef UNIVAC
     putchar(c);
@@ -276,18 +460,17 @@ int is_en_passant(int from, int to, int diff) {
     return ep_square;
 }
 
-// Main play/search function (lines 111-400)
-// This is the heart of the chess engine - recursive minimax search
-int play(ChessState* state, int origin_hint, int target_hint, int current_color, int* best_score) {
-    int bp = MIN_SCORE;  // Current best score for this position
-    int saved_enp = state->enp;  // Save en passant state for restoration
+// Generate pseudo-legal moves for one side (lines 111-240)
+// Walks the board exactly like the assembly move generator and records every
+// candidate move in generation order. Returns the number of moves stored.
+int generate_moves(const ChessState* state, int current_color, Move* moves) {
+    int count = 0;
 
-    // Iterate through all squares looking for pieces to move
-    for (int si = 0; si < 120; si++) {
-        // Skip invalid squares (0x88 board boundary check)
-        if ((si & 0x88) != 0) {
-            continue;
-        }
+    // Squares holding our pieces (dispatched scan kernel), in square order
+    unsigned long long own[2];
+    piece_mask(state->board, current_color, own);
+
+    for (int si; (si = pop_square(own)) >= 0; ) {
         unsigned char piece_at_origin = state->board[si];
         unsigned char piece_type = (piece_at_origin ^ current_color) & PIECE_FULL_MASK;
 
@@ -345,260 +528,6575 @@ int play(ChessState* state, int origin_hint, int target_hint, int current_color,
 
                 // Check if target is empty
                 if (target_type == EMPTY) {
-                    // Special pawn logic: can't capture on straight move
-                    if (movement_offset >= 16 && movement_count < 3) {
-                        // Pawn moving straight - this is OK
-                        goto valid_move;
-                    } else if (movement_offset >= 16) {
-                        // Pawn trying to capture empty square - invalid unless en passant
-                        if (di == state->enp) {
-                            // En passant capture
-                            goto valid_move;
-                        }
-                        break;  // Invalid diagonal pawn move to empty square
+                    // Pawn trying to capture empty square - invalid unless en passant
+                    if (movement_offset >= 16 && di != state->enp) {
+                        break;
                     }
-
-                    goto valid_move;
                 } else {
-                    // Square is occupied
-                    // Check if it's a valid capture
+                    // Square is occupied: only an enemy piece is a valid capture
                     int target_color = target_piece & COLOR_MASK;
 
-                    if (target_color != current_color && (target_type & PIECE_MASK) < 7) {
-                        // Enemy piece - valid capture
-                        goto valid_move;
-                    } else {
-                        // Own piece or frontier
-                        break;
+                    if (target_color == current_color || (target_type & PIECE_MASK) >= 7) {
+                        break;  // Own piece or frontier
                     }
                 }
 
-                continue;
-
-valid_move:
-                // This is a potentially valid move
-
-                // Check for king capture (checkmate)
-                int captured_type = get_piece_type(target_piece);
-                if (captured_type == KING) {
-                    *best_score = KING_CAPTURE_SCORE;
-                    if (state->stack_depth > MAX_DEPTH_PLY1) {
-                        *best_score = MAX_CHECKMATE_SCORE;
-                    }
-                    return 1;  // King captured!
-                }
+                moves[count].from = (unsigned char)si;
+                moves[count].to = (unsigned char)di;
+                moves[count].score = 0;
+                count++;
 
-                // Legal move validation (assembly lines 242-256)
-                // If we're checking a specific move and at root level, check if it matches
-                if (state->legal_move_check && state->stack_depth == 0) {
-                    if (si == origin_hint && di == target_hint) {
-                        // This is the move we're validating - it's legal!
-                        *best_score = 0;  // Return 0 to indicate success
-                        return 0;
-                    }
-                    // Not the move we're looking for, skip evaluation
-                    continue;
+                // For non-sliding pieces (knight, king, pawn), stop after first square
+                // For sliding pieces (rook, bishop, queen), continue until blocked
+                if (!is_sliding_piece || target_type != EMPTY) {
+                    break;  // Non-slider, or blocked - try next direction
                 }
+            }
+        }
+    }
 
-                // Make the move
-                unsigned char saved_target_piece = state->board[di];
-                unsigned char saved_origin_piece = state->board[si];
+    return count;
+}
 
-                state->board[di] = piece_at_origin & PIECE_FULL_MASK;  // Move piece, clear moved bit
-                state->board[si] = EMPTY;
+// Main play/search function (lines 111-400)
+// This is the heart of the chess engine - recursive negamax search.
+// Scores are incremental material: each move is worth the captured piece
+// minus the best reply, searched inside the (alpha, beta) window.
+int play(ChessState* state, int origin_hint, int target_hint, int current_color,
+         int alpha, int beta, int* best_score) {
+    Move moves[MAX_MOVES];
+    Move quiets[MAX_MOVES];
+    int quiet_count = 0;
+    int bp = MIN_SCORE;  // Current best score for this position
+    int saved_enp = state->enp;  // Save en passant state for restoration
+    int saved_limit = state->depth_limit;
+    int ply = state->stack_depth >> 1;
+    int depth = (state->depth_limit - state->stack_depth) >> 1;  // Plies left below this node
+    int original_alpha = alpha;
+    int tt_move = 0;
+    int best_move = 0;
+    int cutoff = -1;
+    int node_type = state->stack_depth == 0 ? NODE_PV : state->node_types[ply];
+    unsigned long long key = state->hash ^ (current_color ? zobrist_side : 0);
 
-                // Recursive search if not at depth limit
-                int move_score = piece_scores[captured_type];
+    if (state->stop) {
+        *best_score = 0;
+        return 0;
+    }
+    state->nodes++;
+    if (state->yield_hook && state->nodes >= state->yield_nodes) {
+        state->yield_hook(state->yield_context);
+        if (state->stop) {
+            *best_score = 0;
+            return 0;
+        }
+    }
 
-                if (state->stack_depth < state->depth_limit) {
-                    int sub_score = 0;
-                    state->stack_depth += 2;
-                    play(state, -1, -1, current_color ^ COLOR_MASK, &sub_score);
-                    state->stack_depth -= 2;
-                    move_score -= sub_score;
+    // Transposition table: hash move for ordering, stored bound for a cutoff
+    if (!state->legal_move_check) {
+        int tt_depth, tt_bound, tt_score;
+        if (tt_probe(key, &tt_move, &tt_depth, &tt_bound, &tt_score)) {
+            state->tt_hits++;
+            if (state->stack_depth > 0 && tt_depth >= depth
+                && (tt_bound == TT_BOUND_EXACT
+                    || (tt_bound == TT_BOUND_LOWER && tt_score >= beta)
+                    || (tt_bound == TT_BOUND_UPPER && tt_score <= alpha))) {
+                *best_score = tt_score;
+                if (state->tree_dump) {
+                    tree_record(state, TREE_HASH, depth, alpha, beta, tt_score, 0, -1);
                 }
+                return 0;
+            }
+        }
+    }
 
-                // Unmake the move
-                state->board[si] = saved_origin_piece;
-                state->board[di] = saved_target_piece;
-
-                // Check if this is the best move so far
-                if (move_score > bp) {
-                    bp = move_score;
-
-                    // Save best move at root level
-                    if (state->stack_depth == 0) {
-                        state->best_from = si;
-                        state->best_to = di;
-                    }
-                }
+    int count = generate_moves(state, current_color, moves);
 
-                // For non-sliding pieces (knight, king, pawn), stop after first square
-                // For sliding pieces (rook, bishop, queen), continue until blocked
-                if (!is_sliding_piece || target_type != EMPTY) {
-                    break;  // Non-slider, or blocked - try next direction
-                }
+    // Check for king capture (checkmate)
+    for (int i = 0; i < count; i++) {
+        if (get_piece_type(state->board[moves[i].to]) == KING) {
+            *best_score = KING_CAPTURE_SCORE;
+            if (state->stack_depth > MAX_DEPTH_PLY1) {
+                *best_score = MAX_CHECKMATE_SCORE;
+            }
+            if (state->stack_depth == 0 && !state->legal_move_check) {
+                state->best_from = moves[i].from;
+                state->best_to = moves[i].to;
+            }
+            if (state->tree_dump) {
+                tree_record(state, TREE_MATE, depth, alpha, beta, *best_score, count, i);
             }
+            return 1;  // King captured!
         }
     }
 
-    // If we're validating a legal move and didn't find it, return illegal score
+    // Legal move validation (assembly lines 242-256)
+    // If we're checking a specific move and at root level, check if it matches
     if (state->legal_move_check && state->stack_depth == 0) {
+        for (int i = 0; i < count; i++) {
+            if (moves[i].from == origin_hint && moves[i].to == target_hint) {
+                // This is the move we're validating - it's legal!
+                *best_score = 0;  // Return 0 to indicate success
+                return 0;
+            }
+        }
         *best_score = ILLEGAL_MOVE_SCORE;
-    } else {
-        *best_score = bp;
+        return 0;
     }
 
-    state->enp = saved_enp;  // Restore en passant state
-    return 0;
-}
-
-// Validate and execute player move (lines 108-110)
-int play_validate(ChessState* state, int origin, int target, int current_color) {
-    state->legal_move_check = 1;
-    state->depth_limit = MAX_DEPTH_PLY1;
-    state->stack_depth = 0;
+    // ProbCut: a good capture that beats beta by a margin at reduced depth
+    if (state->stack_depth > 0 && state->probcut_depth > 0 && depth >= state->probcut_depth) {
+        if (probcut(state, moves, count, current_color, beta, depth, best_score)) {
+            state->enp = saved_enp;
+            if (state->tree_dump) {
+                tree_record(state, TREE_PROBCUT, depth, alpha, beta, *best_score, count, -1);
+            }
+            return 0;
+        }
+    }
 
-    int score = 0;
-    play(state, origin, target, current_color, &score);
+    // No hash move at a PV or cut node: reduce this node by a ply (IIR),
+    // or seed a hash move with a shallower search of the same node first
+    // (IID). Expected all-nodes search every move anyway.
+    if (tt_move == 0 && state->stack_depth > 0 && depth >= state->iir_depth && node_type != NODE_ALL) {
+        if (state->iir_mode == IIR_MODE_REDUCE) {
+            state->depth_limit -= 2;
+            depth--;
+        } else if (state->iir_mode == IIR_MODE_DEEPEN && depth > state->iid_reduction) {
+            int seed_score, tt_depth, tt_bound, tt_score;
+            state->depth_limit -= 2 * state->iid_reduction;
+            state->tree_iid++;
+            play(state, -1, -1, current_color, alpha, beta, &seed_score);
+            state->tree_iid--;
+            state->depth_limit = saved_limit;
+            tt_probe(key, &tt_move, &tt_depth, &tt_bound, &tt_score);
+        }
+    }
 
-    // Check if move was legal (score >= ILLEGAL_MOVE_SCORE)
-    return score;
-}
+    score_moves(state, moves, count, current_color, ply, tt_move);
 
-// Execute computer move (lines 99-103)
-void computer_move(ChessState* state, int color) {
-    state->legal_move_check = 0;
-    state->depth_limit = MAX_DEPTH_PLY0;
-    state->stack_depth = 0;
+    // Root: order by the previous iteration's scores, and collect new ones
+    // (MultiPV: exact for every move within root_margin pawns of the best)
+    int root_scores[MAX_MOVES];
+    int root_margin = state->stack_depth > 0 ? 0 : state->root_margin;
+    if (state->stack_depth == 0) {
+        for (int i = 0; i < count; i++) {
+            for (int r = 0; r < state->root_count; r++) {
+                if (state->root_moves[r].from == moves[i].from && state->root_moves[r].to == moves[i].to) {
+                    moves[i].score = ORDER_TT_MOVE + MAX_MOVES - r;
+                    break;
+                }
+            }
+        }
+    }
 
-    state->best_from = -1;
-    state->best_to = -1;
+    for (int i = 0; i < count; i++) {
+        pick_move(moves, i, count);
+        int si = moves[i].from;
+        int di = moves[i].to;
 
-    int score = 0;
-    play(state, -1, -1, color, &score);
+        // Make the move
+        unsigned char saved_target_piece = state->board[di];
+        unsigned char saved_origin_piece = state->board[si];
+        int captured_type = get_piece_type(saved_target_piece);
+        unsigned long long saved_hash = state->hash;
 
-    // Execute the best move found and display it
-    if (state->best_from >= 0 && state->best_to >= 0) {
-        char from_str[3], to_str[3];
-        position_to_algebraic(state->best_from, from_str);
-        position_to_algebraic(state->best_to, to_str);
-        printf("%s%s\n", from_str, to_str);
-        make_move(state, state->best_from, state->best_to);
-    }
-}
+        state->board[di] = saved_origin_piece & PIECE_FULL_MASK;  // Move piece, clear moved bit
+        state->board[si] = EMPTY;
+        state->hash ^= zobrist_keys[saved_origin_piece & PIECE_FULL_MASK][si]
+                     ^ zobrist_keys[saved_origin_piece & PIECE_FULL_MASK][di]
+                     ^ zobrist_keys[saved_target_piece & PIECE_FULL_MASK][di];
 
-// Make a move on the board
-void make_move(ChessState* state, int from, int to) {
-    unsigned char piece = state->board[from];
-    unsigned char captured = state->board[to];
+        // Recursive search if not at depth limit
+        int move_score = piece_scores[captured_type];
 
-    // Clear moved bit when moving
-    state->board[to] = piece & PIECE_FULL_MASK;
-    state->board[from] = EMPTY;
+        if (state->stack_depth < state->depth_limit) {
+            int sub_score = 0;
+            int window_alpha = (bp - root_margin > alpha) ? bp - root_margin : alpha;
+            state->ply_piece[ply] = piece_index(saved_origin_piece);
+            state->ply_to[ply] = SQ64(di);
+            state->node_types[ply + 1] = node_type == NODE_PV ? (i == 0 ? NODE_PV : NODE_CUT)
+                                                               : (node_type == NODE_CUT ? NODE_ALL : NODE_CUT);
+            state->stack_depth += 2;
+            play(state, -1, -1, current_color ^ COLOR_MASK,
+                 move_score - beta, move_score - window_alpha, &sub_score);
+            state->stack_depth -= 2;
+            move_score -= sub_score;
+            if (state->tree_dump && !state->stop) {
+                tree_set_move(state, si, di);
+            }
+        }
 
-    // Handle special moves (castling, en passant, promotion)
-    int piece_type = get_piece_type(piece);
+        // Unmake the move
+        state->board[si] = saved_origin_piece;
+        state->board[di] = saved_target_piece;
+        state->hash = saved_hash;
 
-    // Check for pawn promotion
-    if (piece_type == PAWN) {
-        if ((to & 0xF0) == 0x00 || (to & 0xF0) == 0x70) {
-            // Promote to queen
-            state->board[to] = (piece & COLOR_MASK) | QUEEN;
+        // Aborted: the score of this move is meaningless
+        if (state->stop) {
+            break;
+        }
+        if (state->stack_depth == 0) {
+            root_scores[i] = move_score;
         }
 
-        // Check for en passant capture
-        int diff = to - from;
-        if ((diff & 0x0F) > 1 || (diff & 0x0F) < -1) {
-            // Diagonal move
-            if (captured == EMPTY && to == state->enp) {
-                // En passant: remove captured pawn
-                int ep_pawn_square;
-                if (diff > 0) {
-                    ep_pawn_square = to - 16;  // White captured black
-                } else {
-                    ep_pawn_square = to + 16;  // Black captured white
+        // Check if this is the best move so far
+        if (move_score > bp) {
+            bp = move_score;
+            best_move = si | (di << 8);
+
+            // Save best move at root level
+            if (state->stack_depth == 0) {
+                state->best_from = si;
+                state->best_to = di;
+            }
+
+            if (bp >= beta) {
+                cutoff = i;
+                state->cutoffs++;
+                if (i == 0) {
+                    state->first_move_cutoffs++;
                 }
-                state->board[ep_pawn_square] = EMPTY;
+                if (captured_type == EMPTY_TYPE) {
+                    update_quiet_stats(state, current_color, ply, depth, &moves[i], quiets, quiet_count);
+                }
+                break;
             }
         }
 
-        // Set en passant target if pawn moved two squares
-        if (diff == 32 || diff == -32) {
-            state->enp = to;
-        } else {
-            state->enp = 0;
+        if (captured_type == EMPTY_TYPE) {
+            quiets[quiet_count++] = moves[i];
         }
-    } else {
-        state->enp = 0;
     }
 
-    // Handle castling
-    if (piece_type == KING) {
-        int diff = to - from;
-        if (diff == 2) {
-            // Castle kingside
-            state->board[to - 1] = state->board[to + 1];
-            state->board[to + 1] = EMPTY;
-        } else if (diff == -2) {
-            // Castle queenside
-            state->board[to + 1] = state->board[to - 2];
-            state->board[to - 2] = EMPTY;
+    state->depth_limit = saved_limit;
+    state->enp = saved_enp;  // Restore en passant state
+
+    if (state->stop) {
+        *best_score = bp;
+        if (state->tree_dump) {
+            tree_record(state, TREE_ABORTED, depth, alpha, beta, bp, count, cutoff);
         }
+        return 0;
     }
-}
 
-// Main game loop (lines 88-103)
-void run_game(ChessState* state) {
-    while (1) {
-        // Display board
-        display_board(state);
+    // Completed root: keep the moves sorted by score (stable) for the next iteration
+    if (state->stack_depth == 0) {
+        state->root_count = 0;
+        for (int i = 0; i < count; i++) {
+            int r = state->root_count++;
+            while (r > 0 && state->root_moves[r - 1].score < root_scores[i]) {
+                state->root_moves[r] = state->root_moves[r - 1];
+                r--;
+            }
+            state->root_moves[r] = moves[i];
+            state->root_moves[r].score = root_scores[i];
+        }
+    }
 
-        // Get player move
-        printf("\nYour move (e.g., D2D4 or 'q' to exit): ");
+    tt_store(key, best_move, depth,
+             bp >= beta ? TT_BOUND_LOWER : (bp > original_alpha ? TT_BOUND_EXACT : TT_BOUND_UPPER), bp);
+    if (state->tree_dump) {
+        tree_record(state, bp >= beta ? TREE_CUT : (bp > original_alpha ? TREE_EXACT : TREE_ALL), depth,
+                    original_alpha, beta, bp, count, cutoff);
+    }
 
-        // Read first character WITHOUT masking to check for quit command
-#ifdef UNIVAC
-        int first_char_raw = getchar();
-#else
-        int first_char_raw = _getch();
-        putchar(first_char_raw);  // Echo the character
-#endif
-        char first_upper = (char)toupper(first_char_raw);
+    *best_score = bp;
+    return 0;
+}
 
-        // Check for 'Q' (quit)
-        if (first_upper == 'Q') {
-            printf("\nThanks for playing!\n");
-            exit(0);
+// Fixed-seed generator for Zobrist keys (splitmix64)
+void init_zobrist(void) {
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+
+    for (int piece = 0; piece < 16; piece++) {
+        for (int sq = 0; sq < BOARD_SIZE; sq++) {
+            unsigned long long z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            // Empty squares and the frontier never contribute to the hash
+            zobrist_keys[piece][sq] = (piece == EMPTY || piece == FRONTIER) ? 0 : (z ^ (z >> 31));
         }
+    }
+    zobrist_side = zobrist_keys[WHITE_KING][0x77] ^ 0xA5A5A5A5A5A5A5A5ULL;
+}
 
-        // Apply masking for chess coordinate processing
-        int from_col = first_char_raw & 0x0F;
-        int from_row = read_key();
-        int to_col = read_key();
-        int to_row = read_key();
+// Full Zobrist hash of the board
+unsigned long long compute_hash(const ChessState* state) {
+    unsigned long long hash = 0;
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        hash ^= zobrist_keys[state->board[sq] & PIECE_FULL_MASK][sq];
+    }
+    return hash;
+}
 
-        // Calculate board positions from coordinates
-        int from = (from_col + 127) - (from_row << 4);
-        int to = (to_col + 127) - (to_row << 4);
-        printf("\n");
+// Next hash key salt (splitmix64 step). A search under a salt no earlier
+// search used finds no hash entries, as if the table had been cleared.
+unsigned long long next_salt(unsigned long long salt) {
+    unsigned long long z = salt + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-        // Validate player move (WHITE)
-        int score = play_validate(state, from, to, WHITE);
+// Allocate the transposition table (entries rounded down to a power of two)
+int tt_init(unsigned long long entries) {
+    unsigned long long size = 1;
+    while (size * 2 <= entries) {
+        size *= 2;
+    }
+    tt_free();
+    tt.entries = (TTEntry*)calloc((size_t)size, sizeof(TTEntry));
+    tt.mask = tt.entries ? size - 1 : 0;
+    return tt.entries != NULL;
+}
 
-        if (score < ILLEGAL_MOVE_SCORE) {
-            printf("Illegal move! Try again.\n");
-            continue;
+// Release the transposition table (heap block or file mapping)
+void tt_free(void) {
+    if (tt.mapping) {
+#ifndef UNIVAC
+        // Windows destroys a named mapping when its last view goes away
+        UnmapViewOfFile(tt.mapping);
+#elif defined(POSIX)
+        int last = tt.shared && ATOMIC_FETCH_ADD(&((TTSharedHeader*)tt.mapping)->attached, -1) == 1;
+        munmap(tt.mapping, (size_t)tt.mapping_size);
+        if (last) {
+            shm_unlink(tt.shared_name);
         }
+#endif
+        tt.mapping = NULL;
+        tt.mapping_size = 0;
+        tt.shared = 0;
+    } else {
+        free(tt.entries);
+    }
+    tt.entries = NULL;
+    tt.mask = 0;
+}
 
-        // Execute player move
-        make_move(state, from, to);
-
-        // Display board after player move
-        display_board(state);
-        printf("\nComputer thinking...");
+// Place the table in a named shared-memory segment so several processes
+// search with one table (same xor-checked entries as between threads).
+// The first process creates and clears the segment with the requested
+// entry count; later ones wait for it to be ready and adopt its size,
+// refusing segments larger than max_bytes. Returns 1 when attached.
+int tt_attach_shared(const char* name, unsigned long long entries, unsigned long long max_bytes) {
+    unsigned long long size = sizeof(TTSharedHeader) + entries * sizeof(TTEntry);
+    TTSharedHeader* header;
+    int creator;
+#ifndef UNIVAC
+    char mapping_name[80];
+    snprintf(mapping_name, sizeof(mapping_name), "Local\\%s", name);
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                        (DWORD)(size >> 32), (DWORD)size, mapping_name);
+    if (mapping == NULL) {
+        return 0;
+    }
+    creator = GetLastError() != ERROR_ALREADY_EXISTS;
+    header = (TTSharedHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    CloseHandle(mapping);
+    if (header == NULL) {
+        return 0;
+    }
+    if (!creator) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(header, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+#elif defined(POSIX)
+    char shm_name[80];
+    snprintf(shm_name, sizeof(shm_name), "/%s", name);
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    creator = fd >= 0;
+    if (creator) {
+        if (ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            shm_unlink(shm_name);
+            return 0;
+        }
+    } else {
+        struct stat st;
+        long long deadline = get_time_ms() + TT_SHARED_WAIT_MS;
+        fd = shm_open(shm_name, O_RDWR, 0600);
+        if (fd < 0) {
+            return 0;
+        }
+        // The creator may not have sized the segment yet
+        while (fstat(fd, &st) == 0 && (unsigned long long)st.st_size < sizeof(TTSharedHeader)) {
+            if (get_time_ms() > deadline) {
+                close(fd);
+                return 0;
+            }
+            usleep(1000);
+        }
+        size = (unsigned long long)st.st_size;
+    }
+    header = (TTSharedHeader*)mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == (TTSharedHeader*)MAP_FAILED) {
+        if (creator) {
+            shm_unlink(shm_name);
+        }
+        return 0;
+    }
+#else
+    (void)name;
+    (void)entries;
+    (void)max_bytes;
+    (void)size;
+    (void)header;
+    (void)creator;
+    return 0;
+#endif
+#if !defined(UNIVAC) || defined(POSIX)
+    if (creator) {
+        memcpy(header->magic, TT_SHARED_MAGIC, sizeof(TT_SHARED_MAGIC));
+        header->version = TT_SHARED_VERSION;
+        header->entry_size = (unsigned int)sizeof(TTEntry);
+        header->entries = entries;
+        header->attached = 1;
+        memset(header + 1, 0, (size_t)(entries * sizeof(TTEntry)));
+        MEMORY_BARRIER();
+        header->ready = 1;
+    } else {
+        long long deadline = get_time_ms() + TT_SHARED_WAIT_MS;
+        while (!header->ready && get_time_ms() < deadline) {
+#ifndef UNIVAC
+            Sleep(1);
+#else
+            usleep(1000);
+#endif
+        }
+        MEMORY_BARRIER();
+        if (!header->ready || memcmp(header->magic, TT_SHARED_MAGIC, sizeof(TT_SHARED_MAGIC)) != 0
+            || header->version != TT_SHARED_VERSION || header->entry_size != sizeof(TTEntry)
+            || header->entries == 0 || (header->entries & (header->entries - 1)) != 0
+            || header->entries * sizeof(TTEntry) > max_bytes
+            || sizeof(TTSharedHeader) + header->entries * sizeof(TTEntry) > size) {
+#ifndef UNIVAC
+            UnmapViewOfFile(header);
+#else
+            munmap(header, (size_t)size);
+#endif
+            return 0;
+        }
+        ATOMIC_FETCH_ADD(&header->attached, 1);
+        entries = header->entries;
+    }
 
-        // Computer move (BLACK)
+    tt_free();
+    tt.mapping = header;
+    tt.mapping_size = size;
+    tt.shared = 1;
+    tt.entries = (TTEntry*)(header + 1);
+    tt.mask = entries - 1;
+#ifdef UNIVAC
+    SAFE_STRCPY(tt.shared_name, shm_name, sizeof(tt.shared_name));
+#endif
+    return 1;
+#endif
+}
+
+// Header describing the current table
+void tt_file_header(TTFileHeader* header) {
+    memset(header, 0, sizeof(TTFileHeader));
+    memcpy(header->magic, TT_FILE_MAGIC, sizeof(TT_FILE_MAGIC));
+    header->version = TT_FILE_VERSION;
+    header->entry_size = (unsigned int)sizeof(TTEntry);
+    header->entries = tt.entries ? tt.mask + 1 : 0;
+    header->zobrist_check = zobrist_keys[WHITE_KING][0x74] ^ zobrist_side;
+}
+
+// Write the table to disk: header, then entries in large sequential chunks
+int tt_save(const char* path) {
+    TTFileHeader header;
+    FILE* file = fopen(path, "wb");
+
+    if (!file) {
+        return 0;
+    }
+    setvbuf(file, NULL, _IONBF, 0);  // Chunks are large enough to skip stdio buffering
+    tt_file_header(&header);
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    const unsigned char* data = (const unsigned char*)tt.entries;
+    unsigned long long remaining = header.entries * sizeof(TTEntry);
+
+    while (ok && remaining > 0) {
+        size_t chunk = remaining > TT_IO_CHUNK ? TT_IO_CHUNK : (size_t)remaining;
+        ok = fwrite(data, 1, chunk, file) == chunk;
+        data += chunk;
+        remaining -= chunk;
+    }
+
+    return (fclose(file) == 0) && ok;
+}
+
+// Map a saved table of the current size copy-on-write: pages are shared
+// with the page cache until the search writes to them
+int tt_map_file(const char* path, unsigned long long entries) {
+    unsigned long long size = sizeof(TTFileHeader) + entries * sizeof(TTEntry);
+#ifndef UNIVAC
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return 0;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, (SIZE_T)size);
+    CloseHandle(mapping);  // The view keeps the mapping alive
+    if (base == NULL) {
+        return 0;
+    }
+#elif defined(POSIX)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    void* base = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+#else
+    (void)path;
+    (void)size;
+    return 0;
+#endif
+#if !defined(UNIVAC) || defined(POSIX)
+    tt_free();
+    tt.mapping = base;
+    tt.mapping_size = size;
+    tt.entries = (TTEntry*)((unsigned char*)base + sizeof(TTFileHeader));
+    tt.mask = entries - 1;
+    return 1;
+#endif
+}
+
+// Load a saved table. A file of the current size is mapped copy-on-write
+// (or read in large chunks); any other size is rehashed entry by entry
+// into the current table so the memory budget is never exceeded.
+int tt_load(const char* path, int use_mmap) {
+    TTFileHeader header;
+    TTFileHeader expected;
+    FILE* file = fopen(path, "rb");
+
+    if (!file) {
+        return 0;
+    }
+    tt_file_header(&expected);
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+        || header.version != TT_FILE_VERSION
+        || header.entry_size != sizeof(TTEntry)
+        || header.zobrist_check != expected.zobrist_check) {
+        fclose(file);
+        return 0;
+    }
+
+    if (header.entries == expected.entries && use_mmap) {
+        fclose(file);
+        return tt_map_file(path, header.entries) || tt_load(path, 0);
+    }
+
+    setvbuf(file, NULL, _IONBF, 0);
+    int ok = 1;
+    if (header.entries == expected.entries) {
+        unsigned char* data = (unsigned char*)tt.entries;
+        unsigned long long remaining = header.entries * sizeof(TTEntry);
+        while (ok && remaining > 0) {
+            size_t chunk = remaining > TT_IO_CHUNK ? TT_IO_CHUNK : (size_t)remaining;
+            ok = fread(data, 1, chunk, file) == chunk;
+            data += chunk;
+            remaining -= chunk;
+        }
+    } else {
+        TTEntry buffer[TT_REHASH_BATCH];
+        unsigned long long remaining = header.entries;
+        while (ok && remaining > 0) {
+            size_t count = remaining > TT_REHASH_BATCH ? TT_REHASH_BATCH : (size_t)remaining;
+            ok = fread(buffer, sizeof(TTEntry), count, file) == count;
+            for (size_t i = 0; ok && tt.entries && i < count; i++) {
+                if (buffer[i].data != 0) {
+                    tt.entries[(buffer[i].key ^ buffer[i].data) & tt.mask] = buffer[i];
+                }
+            }
+            remaining -= count;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+// Handle "tt save <file>" and "tt load <file>"; returns 1 on success
+int tt_command(const char* line, int use_mmap) {
+    char verb[8];
+    char path[260];
+
+    if (sscanf(line, " tt %7s %259s", verb, path) != 2) {
+        return 0;
+    }
+    if (strcmp(verb, "save") == 0) {
+        return tt_save(path);
+    }
+    if (strcmp(verb, "load") == 0) {
+        return tt_load(path, use_mmap);
+    }
+    return 0;
+}
+
+// Forget all stored positions
+void tt_clear(void) {
+    if (tt.entries) {
+        memset(tt.entries, 0, (size_t)(tt.mask + 1) * sizeof(TTEntry));
+    }
+}
+
+// Look up a position; returns 1 and the unpacked fields on a hit
+int tt_probe(unsigned long long key, int* move, int* depth, int* bound, int* score) {
+    if (!tt.entries) {
+        return 0;
+    }
+    const TTEntry* entry = &tt.entries[key & tt.mask];
+    unsigned long long data = entry->data;
+    if ((entry->key ^ data) != key || data == 0) {
+        return 0;
+    }
+    *move = (int)(data & 0xFFFF);
+    *depth = (int)((data >> 16) & 0xFF);
+    *bound = (int)((data >> 24) & 0x03);
+    *score = (int)(long long)(data >> 32) - INFINITE_SCORE;
+    return 1;
+}
+
+// Store a search result (always replaces)
+void tt_store(unsigned long long key, int move, int depth, int bound, int score) {
+    if (!tt.entries) {
+        return;
+    }
+    TTEntry* entry = &tt.entries[key & tt.mask];
+    unsigned long long data = (unsigned long long)(move & 0xFFFF)
+                            | ((unsigned long long)((depth > 0 ? depth : 0) & 0xFF) << 16)
+                            | ((unsigned long long)bound << 24)
+                            | ((unsigned long long)(unsigned int)(score + INFINITE_SCORE) << 32);
+    entry->key = key ^ data;
+    entry->data = data;
+}
+
+// Material value used by static exchange evaluation
+int see_value(unsigned char piece) {
+    int type = get_piece_type(piece);
+    return (type == KING) ? SEE_KING_VALUE : piece_scores[type];
+}
+
+// Find the least valuable piece of the given color that can capture on sq,
+// following the same movement rules as generate_moves(). Returns -1 if none.
+int least_attacker(const ChessState* state, int sq, int color) {
+    int best_sq = -1;
+    int best_value = SEE_KING_VALUE + 1;
+
+    // Pawns, knights and king: single-step displacements
+    static const struct { int type; int offset; int count; } steppers[] = {
+        { PAWN, -1, 4 }, { KNIGHT, DISP_KNIGHT, 8 }, { KING, DISP_KING, 8 }
+    };
+    for (int k = 0; k < 3; k++) {
+        int offset = steppers[k].offset;
+        if (offset < 0) {
+            offset = (color == BLACK) ? DISP_PAWN_BLACK : DISP_PAWN_WHITE;
+        }
+        for (int d = 0; d < steppers[k].count; d++) {
+            int from = sq - displacement[offset + d];
+            if (from < 0 || from >= BOARD_SIZE || (from & 0x88) != 0) {
+                continue;
+            }
+            unsigned char piece = state->board[from];
+            if (piece != EMPTY && get_piece_color(piece) == color
+                && get_piece_type(piece) == steppers[k].type && see_value(piece) < best_value) {
+                best_sq = from;
+                best_value = see_value(piece);
+            }
+        }
+    }
+
+    // Sliders: walk each ray from the target until the first piece
+    for (int d = 0; d < 8; d++) {
+        int step = displacement[DISP_KING + d];
+        int diagonal = (d >= 4);
+        for (int from = sq - step; from >= 0 && from < BOARD_SIZE && (from & 0x88) == 0; from -= step) {
+            unsigned char piece = state->board[from];
+            if (piece == EMPTY) {
+                continue;
+            }
+            int type = get_piece_type(piece);
+            if (get_piece_color(piece) == color
+                && (type == QUEEN || type == (diagonal ? BISHOP : ROOK))
+                && see_value(piece) < best_value) {
+                best_sq = from;
+                best_value = see_value(piece);
+            }
+            break;
+        }
+    }
+
+    return best_sq;
+}
+
+// Static exchange evaluation of the capture from -> to (swap algorithm)
+// Attackers are lifted off the board as they capture so x-rays appear;
+// the board is restored before returning.
+int see(ChessState* state, int from, int to) {
+    int gain[32];
+    int removed[32];
+    unsigned char removed_piece[32];
+    int d = 0;
+    int color = get_piece_color(state->board[from]) ^ COLOR_MASK;
+    unsigned char target = state->board[to];
+    unsigned char on_square = state->board[from];
+
+    gain[0] = see_value(target);
+    removed[0] = from;
+    removed_piece[0] = on_square;
+    state->board[from] = EMPTY;
+
+    while (d < 31) {
+        int attacker = least_attacker(state, to, color);
+        if (attacker < 0) {
+            break;
+        }
+        d++;
+        gain[d] = see_value(on_square) - gain[d - 1];
+        on_square = state->board[attacker];
+        removed[d] = attacker;
+        removed_piece[d] = on_square;
+        state->board[attacker] = EMPTY;
+        color ^= COLOR_MASK;
+    }
+
+    for (int i = d; i >= 0; i--) {
+        state->board[removed[i]] = removed_piece[i];
+    }
+
+    while (d > 0) {
+        if (-gain[d] < gain[d - 1]) {
+            gain[d - 1] = -gain[d];
+        }
+        d--;
+    }
+    return gain[0];
+}
+
+// ProbCut (deep nodes only): try SEE-positive captures with a reduced-depth
+// null-window search against beta + margin. Returns 1 and the score on a cut.
+int probcut(ChessState* state, const Move* moves, int count, int current_color, int beta, int depth, int* best_score) {
+    int raised_beta = beta + state->probcut_margin;
+    int ply = state->stack_depth >> 1;
+    int saved_limit = state->depth_limit;
+
+    for (int i = 0; i < count; i++) {
+        int si = moves[i].from;
+        int di = moves[i].to;
+        unsigned char saved_target_piece = state->board[di];
+        unsigned char saved_origin_piece = state->board[si];
+
+        if (saved_target_piece == EMPTY || see(state, si, di) < 0) {
+            continue;
+        }
+
+        int move_score = piece_scores[get_piece_type(saved_target_piece)];
+        int sub_score = 0;
+
+        unsigned long long saved_hash = state->hash;
+
+        state->board[di] = saved_origin_piece & PIECE_FULL_MASK;
+        state->board[si] = EMPTY;
+        state->hash ^= zobrist_keys[saved_origin_piece & PIECE_FULL_MASK][si]
+                     ^ zobrist_keys[saved_origin_piece & PIECE_FULL_MASK][di]
+                     ^ zobrist_keys[saved_target_piece & PIECE_FULL_MASK][di];
+        state->ply_piece[ply] = piece_index(saved_origin_piece);
+        state->ply_to[ply] = SQ64(di);
+
+        // Shrink the depth limit so the subtree below is depth - reduction plies
+        state->depth_limit = state->stack_depth + 2 * (depth - state->probcut_reduction);
+        if (state->depth_limit < state->stack_depth + 2) {
+            state->depth_limit = state->stack_depth + 2;
+        }
+        state->node_types[ply + 1] = NODE_CUT;
+        state->stack_depth += 2;
+        play(state, -1, -1, current_color ^ COLOR_MASK,
+             move_score - raised_beta, move_score - raised_beta + 1, &sub_score);
+        state->stack_depth -= 2;
+        state->depth_limit = saved_limit;
+
+        state->board[si] = saved_origin_piece;
+        state->board[di] = saved_target_piece;
+        state->hash = saved_hash;
+
+        if (!state->stop && move_score - sub_score >= raised_beta) {
+            state->probcut_cutoffs++;
+            *best_score = move_score - sub_score;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Size every table from one budget and report the footprint actually used.
+// The budget is laid out for one search thread: its state is fixed,
+// continuation history is allocated only when it fits in its share, and the
+// transposition table takes the largest power of two that fits in what
+// remains. Each extra thread then gets the same private tables on top, so
+// the thread count never changes the table configuration. Returns bytes
+// used, 0 on failure.
+unsigned long long apply_memory_budget(ChessState* state, int memory_kb) {
+    unsigned long long budget = (unsigned long long)(memory_kb > 0 ? memory_kb : 0) * 1024;
+    unsigned long long used = sizeof(ChessState);
+    unsigned long long cont_bytes = (unsigned long long)CONT_HIST_SIZE * sizeof(short);
+
+    if (state->threads < 1) {
+        state->threads = 1;
+    }
+    if (state->threads > MAX_THREADS) {
+        printf("Threads limited to %d on this build\n", MAX_THREADS);
+        state->threads = MAX_THREADS;
+    }
+
+    for (int i = 0; i < helper_count; i++) {
+        free_search_tables(&helper_states[i]);
+    }
+    free(helper_states);
+    helper_states = NULL;
+    helper_count = 0;
+    free_search_tables(state);
+    tt_free();
+
+    if (budget < used) {
+        printf("Memory budget %d KB is below the %llu KB search state\n",
+               memory_kb, (used + 1023) / 1024);
+        return 0;
+    }
+
+    int use_cont_hist = cont_bytes * CONT_HIST_BUDGET_SHARE <= budget - used;
+    if (use_cont_hist) {
+        if (!init_search_tables(state)) {
+            printf("Cannot allocate the continuation history\n");
+            return 0;
+        }
+        used += cont_bytes;
+    }
+
+    if (budget - used >= TT_BYTES_PER_ENTRY) {
+        if (!tt_init((budget - used) / TT_BYTES_PER_ENTRY)) {
+            return 0;
+        }
+        // A shared table replaces the private one, within the same budget
+        if (state->tt_shared_name
+            && !tt_attach_shared(state->tt_shared_name, tt.mask + 1, budget - used)) {
+            printf("Cannot attach shared hash table %s, using a private one\n", state->tt_shared_name);
+        }
+        used += (tt.mask + 1) * TT_BYTES_PER_ENTRY;
+    }
+
+    // Helpers mirror the main thread's private tables
+    if (state->threads > 1) {
+        helper_states = (ChessState*)calloc((size_t)state->threads - 1, sizeof(ChessState));
+        if (!helper_states) {
+            printf("Cannot allocate %d helper threads\n", state->threads - 1);
+            return 0;
+        }
+        helper_count = state->threads - 1;
+        for (int i = 0; i < helper_count; i++) {
+            if (use_cont_hist && !init_search_tables(&helper_states[i])) {
+                printf("Cannot allocate the continuation history for %d threads\n", state->threads);
+                return 0;
+            }
+        }
+        used += (unsigned long long)helper_count * (sizeof(ChessState) + (use_cont_hist ? cont_bytes : 0));
+    }
+
+    return used;
+}
+
+// Print the footprint chosen by apply_memory_budget()
+void report_memory(const ChessState* state, unsigned long long used) {
+    unsigned long long thread_bytes = sizeof(ChessState) + (state->cont_hist ? CONT_HIST_SIZE * sizeof(short) : 0);
+    printf("Memory: %llu of %d KB + %llu KB per extra thread (%d threads, %shash %llu entries, "
+           "continuation history %s)\n", (used - helper_count * thread_bytes + 1023) / 1024, state->memory_kb,
+           (thread_bytes + 1023) / 1024, state->threads, tt.shared ? "shared " : "",
+           tt.entries ? tt.mask + 1 : 0ULL, state->cont_hist ? "on" : "off");
+}
+
+// Default search parameters
+void init_search_params(ChessState* state) {
+    state->memory_kb = DEFAULT_MEMORY_KB;
+    state->threads = 1;
+    state->tt_mmap = 1;
+    state->checkpoint_ms = CHECKPOINT_INTERVAL_MS;
+    state->iir_mode = IIR_MODE_REDUCE;
+    state->iir_depth = IIR_DEPTH;
+    state->iid_reduction = IID_REDUCTION;
+    state->history_bonus = HISTORY_BONUS;
+    state->probcut_depth = PROBCUT_DEPTH;
+    state->probcut_reduction = PROBCUT_REDUCTION;
+    state->probcut_margin = PROBCUT_MARGIN;
+    state->effort_control = 1;
+    state->effort_floor = EFFORT_FLOOR;
+    state->effort_min_depth = EFFORT_MIN_DEPTH;
+    state->effort_knodes = EFFORT_KNODES;
+    state->skill = SKILL_LEVELS;
+    state->deadline_nodes = DEADLINE_CHECK_NODES;
+    state->deadline_reserve_us = DEADLINE_RESERVE_US;
+}
+
+// Search parameters settable at run time (-set name=value or -name value)
+const SearchParam search_params[] = {
+    {"iir-mode", offsetof(ChessState, iir_mode), IIR_MODE_OFF, IIR_MODE_DEEPEN, 0},
+    {"iir-depth", offsetof(ChessState, iir_depth), 1, 10, 1},
+    {"iid-reduction", offsetof(ChessState, iid_reduction), 1, 4, 1},
+    {"history-bonus", offsetof(ChessState, history_bonus), 4, 256, 8},
+    {"probcut-depth", offsetof(ChessState, probcut_depth), 0, 12, 1},
+    {"probcut-reduction", offsetof(ChessState, probcut_reduction), 1, 8, 1},
+    {"probcut-margin", offsetof(ChessState, probcut_margin), 0, 10, 1},
+    {"effort-control", offsetof(ChessState, effort_control), 0, 1, 0},
+    {"effort-floor", offsetof(ChessState, effort_floor), 1, 100, 0},
+    {"effort-min-depth", offsetof(ChessState, effort_min_depth), 1, MAX_PLY / 2, 0},
+    {"effort-knodes", offsetof(ChessState, effort_knodes), 1, 1000000, 0},
+    {"skill", offsetof(ChessState, skill), 1, SKILL_LEVELS, 0},
+    {"deadline-ms", offsetof(ChessState, deadline_ms), 0, 3600000, 0},
+    {"deadline-nodes", offsetof(ChessState, deadline_nodes), 64, 1000000, 0},
+    {"deadline-reserve-us", offsetof(ChessState, deadline_reserve_us), 0, 1000000, 0},
+};
+const int search_param_count = (int)(sizeof(search_params) / sizeof(search_params[0]));
+
+// Index of a parameter by name, or -1
+int find_search_param(const char* name) {
+    for (int i = 0; i < search_param_count; i++) {
+        if (strcmp(search_params[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Set a parameter, clamped to its range; returns 0 for unknown names
+int set_search_param(ChessState* state, const char* name, int value) {
+    int index = find_search_param(name);
+    if (index < 0) {
+        return 0;
+    }
+    const SearchParam* param = &search_params[index];
+    value = value < param->min ? param->min : value > param->max ? param->max : value;
+    *(int*)((char*)state + param->offset) = value;
+    return 1;
+}
+
+int get_search_param(const ChessState* state, int index) {
+    return *(const int*)((const char*)state + search_params[index].offset);
+}
+
+// Print the parameter table with current values
+void list_search_params(const ChessState* state) {
+    printf("name,value,min,max,spsa_step\n");
+    for (int i = 0; i < search_param_count; i++) {
+        const SearchParam* param = &search_params[i];
+        printf("%s,%d,%d,%d,%d\n", param->name, get_search_param(state, i), param->min, param->max, param->spsa_step);
+    }
+}
+
+// Parse "-name value" search options; returns the index of the first non-option
+int parse_options(ChessState* state, int argc, char** argv) {
+    int i = 1;
+    while (i + 1 < argc && argv[i][0] == '-') {
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-tt-load") == 0) {
+            state->tt_load_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-tt-save") == 0) {
+            state->tt_save_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-tt-shared") == 0) {
+            state->tt_shared_name = argv[i + 1];
+        } else if (strcmp(argv[i], "-tt-mmap") == 0) {
+            state->tt_mmap = value;
+        } else if (strcmp(argv[i], "-cpu") == 0) {
+            state->cpu_kernel = argv[i + 1];
+        } else if (strcmp(argv[i], "-log") == 0) {
+            state->log_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-tree") == 0) {
+            state->tree_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-checkpoint-ms") == 0) {
+            state->checkpoint_ms = value;
+        } else if (strcmp(argv[i], "-memory") == 0) {
+            state->memory_kb = value;
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            state->threads = value;
+        } else if (strcmp(argv[i], "-set") == 0) {
+            // "-set name=value" for any entry of the parameter table
+            char name[64];
+            const char* equals = strchr(argv[i + 1], '=');
+            int length = equals ? (int)(equals - argv[i + 1]) : 0;
+            snprintf(name, sizeof(name), "%.*s", length < 63 ? length : 63, argv[i + 1]);
+            if (!equals || !set_search_param(state, name, atoi(equals + 1))) {
+                printf("Unknown parameter %s\n", argv[i + 1]);
+            }
+        } else if (set_search_param(state, argv[i] + 1, value)) {
+            // "-name value" shorthand for table parameters
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+        }
+        i += 2;
+    }
+    return i;
+}
+
+// Map a piece (color + type) to 0-11 for the history tables
+int piece_index(unsigned char piece) {
+    int type = get_piece_type(piece);
+    if (type < PAWN || type > KING) {
+        return 0;
+    }
+    return (type - 1) + ((piece & COLOR_MASK) ? 6 : 0);
+}
+
+// Allocate the continuation history (sized by apply_memory_budget())
+int init_search_tables(ChessState* state) {
+    state->cont_hist = (short*)calloc(CONT_HIST_SIZE, sizeof(short));
+    return state->cont_hist != NULL;
+}
+
+// Release tables allocated by init_search_tables()
+void free_search_tables(ChessState* state) {
+    free(state->cont_hist);
+    state->cont_hist = NULL;
+}
+
+// Forget all move ordering knowledge (new game)
+void clear_search_tables(ChessState* state) {
+    memset(state->killers, 0, sizeof(state->killers));
+    memset(state->counter_moves, 0, sizeof(state->counter_moves));
+    memset(state->history, 0, sizeof(state->history));
+    if (state->cont_hist) {
+        memset(state->cont_hist, 0, CONT_HIST_SIZE * sizeof(short));
+    }
+}
+
+// Continuation history entry for (piece, to) following (prev_piece, prev_to)
+#define CONT_ENTRY(state, prev_piece, prev_to, piece, to) \
+    ((state)->cont_hist[(((prev_piece) * 64 + (prev_to)) * PIECE_INDEX_COUNT + (piece)) * 64 + (to)])
+
+// Assign ordering scores: hash move, captures (MVV-LVA), killers, countermove, then the
+// sum of butterfly and one/two-ply continuation histories for quiet moves
+void score_moves(const ChessState* state, Move* moves, int count, int current_color, int ply, int tt_move) {
+    int color_idx = current_color ? 1 : 0;
+    unsigned short counter = 0;
+
+    if (ply >= 1) {
+        counter = state->counter_moves[state->ply_piece[ply - 1]][state->ply_to[ply - 1]];
+    }
+
+    for (int i = 0; i < count; i++) {
+        int from = moves[i].from;
+        int to = moves[i].to;
+        unsigned char piece = state->board[from];
+        unsigned char victim = state->board[to];
+        unsigned short packed = (unsigned short)(from | (to << 8));
+
+        if (packed == tt_move) {
+            moves[i].score = ORDER_TT_MOVE;
+        } else if (victim != EMPTY) {
+            moves[i].score = ORDER_CAPTURE + piece_scores[get_piece_type(victim)] * 16
+                             - piece_scores[get_piece_type(piece)];
+        } else if (packed == state->killers[ply][0]) {
+            moves[i].score = ORDER_KILLER + 1;
+        } else if (packed == state->killers[ply][1]) {
+            moves[i].score = ORDER_KILLER;
+        } else if (packed == counter) {
+            moves[i].score = ORDER_COUNTER;
+        } else {
+            int pi = piece_index(piece);
+            int to64 = SQ64(to);
+            int score = state->history[color_idx][SQ64(from)][to64];
+            if (state->cont_hist && ply >= 1) {
+                score += CONT_ENTRY(state, state->ply_piece[ply - 1], state->ply_to[ply - 1], pi, to64);
+            }
+            if (state->cont_hist && ply >= 2) {
+                score += CONT_ENTRY(state, state->ply_piece[ply - 2], state->ply_to[ply - 2], pi, to64);
+            }
+            moves[i].score = score;
+        }
+    }
+}
+
+// Bring the best remaining move to position index (selection sort step)
+void pick_move(Move* moves, int index, int count) {
+    int best = index;
+    for (int i = index + 1; i < count; i++) {
+        if (moves[i].score > moves[best].score) {
+            best = i;
+        }
+    }
+    if (best != index) {
+        Move tmp = moves[index];
+        moves[index] = moves[best];
+        moves[best] = tmp;
+    }
+}
+
+// Saturating history update: entries converge towards +/-HISTORY_MAX
+#define HISTORY_UPDATE(entry, bonus) \
+    ((entry) += (short)((bonus) - (entry) * abs(bonus) / HISTORY_MAX))
+
+// Reward the quiet move that caused a cutoff and penalize the quiets tried before it
+void update_quiet_stats(ChessState* state, int current_color, int ply, int depth,
+                        const Move* best, const Move* quiets, int quiet_count) {
+    int color_idx = current_color ? 1 : 0;
+    int bonus = (depth + 1) * (depth + 1) * state->history_bonus;
+    unsigned short packed = (unsigned short)(best->from | (best->to << 8));
+
+    if (bonus > HISTORY_MAX / 2) {
+        bonus = HISTORY_MAX / 2;
+    }
+
+    if (state->killers[ply][0] != packed) {
+        state->killers[ply][1] = state->killers[ply][0];
+        state->killers[ply][0] = packed;
+    }
+    if (ply >= 1) {
+        state->counter_moves[state->ply_piece[ply - 1]][state->ply_to[ply - 1]] = packed;
+    }
+
+    for (int i = -1; i < quiet_count; i++) {
+        const Move* m = (i < 0) ? best : &quiets[i];
+        int delta = (i < 0) ? bonus : -bonus;
+        int pi = piece_index(state->board[m->from]);
+        int to64 = SQ64(m->to);
+
+        HISTORY_UPDATE(state->history[color_idx][SQ64(m->from)][to64], delta);
+        if (state->cont_hist && ply >= 1) {
+            HISTORY_UPDATE(CONT_ENTRY(state, state->ply_piece[ply - 1], state->ply_to[ply - 1], pi, to64), delta);
+        }
+        if (state->cont_hist && ply >= 2) {
+            HISTORY_UPDATE(CONT_ENTRY(state, state->ply_piece[ply - 2], state->ply_to[ply - 2], pi, to64), delta);
+        }
+    }
+}
+
+// Validate and execute player move (lines 108-110)
+int play_validate(ChessState* state, int origin, int target, int current_color) {
+    state->legal_move_check = 1;
+    state->depth_limit = MAX_DEPTH_PLY1;
+    state->stack_depth = 0;
+
+    int score = 0;
+    play(state, origin, target, current_color, -INFINITE_SCORE, INFINITE_SCORE, &score);
+
+    // Check if move was legal (score >= ILLEGAL_MOVE_SCORE)
+    return score;
+}
+
+// Check a player's move: one the engine generates, or a pawn push or
+// castling, which make_move plays but the generator leaves out. (The
+// score of play_validate() alone is 0 for a generated move and never
+// below ILLEGAL_MOVE_SCORE, so it cannot reject anything by itself.)
+int move_is_legal(ChessState* state, int from, int to, int color) {
+    if (((from | to) & ~0x77) != 0) {
+        return 0;  // Off the board
+    }
+    unsigned char piece = state->board[from];
+    int type = get_piece_type(piece);
+
+    if (type == EMPTY_TYPE || (piece & COLOR_MASK) != color) {
+        return 0;
+    }
+    if (type == PAWN) {
+        int forward = color == WHITE ? -16 : 16;
+        int home_row = color == WHITE ? 0x60 : 0x10;
+        if (to == from + forward && state->board[to] == EMPTY) {
+            return 1;
+        }
+        if (to == from + 2 * forward && (from & 0xF0) == home_row
+            && state->board[from + forward] == EMPTY && state->board[to] == EMPTY) {
+            return 1;
+        }
+    }
+    if (type == KING) {
+        int king_row = color == WHITE ? 0x70 : 0x00;
+        unsigned char rook = (unsigned char)(ROOK | color);
+        if (from == king_row + 4 && to == king_row + 6 && state->board[king_row + 5] == EMPTY
+            && state->board[king_row + 6] == EMPTY && (state->board[king_row + 7] & PIECE_FULL_MASK) == rook) {
+            return 1;
+        }
+        if (from == king_row + 4 && to == king_row + 2 && state->board[king_row + 1] == EMPTY
+            && state->board[king_row + 2] == EMPTY && state->board[king_row + 3] == EMPTY
+            && (state->board[king_row] & PIECE_FULL_MASK) == rook) {
+            return 1;
+        }
+    }
+    return play_validate(state, from, to, color) == 0;
+}
+
+// Search the current position and leave the best move in best_from/best_to
+int search_position(ChessState* state, int color, int depth_limit) {
+    state->legal_move_check = 0;
+    state->depth_limit = depth_limit;
+    state->stack_depth = 0;
+
+    state->best_from = -1;
+    state->best_to = -1;
+    state->hash = compute_hash(state) ^ state->hash_salt;
+
+    int score = 0;
+    play(state, -1, -1, color, -INFINITE_SCORE, INFINITE_SCORE, &score);
+    return score;
+}
+
+// Iterative deepening up to depth_limit; the hash moves of each iteration
+// order the next one. Stops early (keeping the last best move) on abort.
+int iterative_search(ChessState* state, int color, int depth_limit) {
+    int score = 0;
+    int best_from = -1;
+    int best_to = -1;
+    int first_limit = state->start_depth > 0 ? state->start_depth * 2 : 2;
+
+    // A resumed search keeps the restored root order and starts deeper
+    if (state->start_depth <= 0) {
+        state->root_count = 0;
+    }
+
+    for (int limit = first_limit; limit <= depth_limit && !state->stop; limit += 2) {
+        int iteration_score = search_position(state, color, limit);
+        if (state->stop && best_from >= 0) {
+            // Root moves searched to the end before the abort may have found a better move
+            if (state->keep_partial && state->best_from >= 0) {
+                score = iteration_score;
+                best_from = state->best_from;
+                best_to = state->best_to;
+            }
+            break;
+        }
+        score = iteration_score;
+        best_from = state->best_from;
+        best_to = state->best_to;
+        if (async_log && !state->stop) {
+            log_push(state->thread_id, LOG_ITERATION, 0, limit / 2, score, best_from, best_to, state->nodes);
+        }
+        if (state->iteration_hook && !state->stop) {
+            state->iteration_hook(state->hook_context, limit / 2, score);
+        }
+    }
+
+    state->best_from = best_from;
+    state->best_to = best_to;
+    return score;
+}
+
+// Lazy SMP helper: deepen the same position until told to stop, filling
+// the shared hash table. Odd helpers start one ply deeper to diversify.
+void helper_search(void* arg) {
+    ChessState* helper = (ChessState*)arg;
+    for (int limit = 2 + (helper->thread_id & 1) * 2; !helper->stop && limit < 2 * (MAX_PLY - 1); limit += 2) {
+        int score = search_position(helper, helper->search_color, limit);
+        if (async_log && !helper->stop) {
+            log_push(helper->thread_id, LOG_ITERATION, 0, limit / 2, score,
+                     helper->best_from, helper->best_to, helper->nodes);
+        }
+    }
+}
+
+// Search with the main thread plus helper_count Lazy SMP helpers. The main
+// thread's iterative deepening decides the move; helpers stop when it ends.
+// The caller clears state->stop, so an abort requested before the search
+// starts is not lost.
+int parallel_search(ChessState* state, int color, int depth_limit) {
+    thread_handle threads[MAX_THREADS];
+    int started = 0;
+
+    for (int i = 0; i < helper_count; i++) {
+        ChessState* helper = &helper_states[i];
+        short* cont_hist = helper->cont_hist;
+
+        // Helpers start from the main thread's position, parameters and histories
+        memcpy(helper, state, sizeof(ChessState));
+        if (cont_hist && state->cont_hist) {
+            memcpy(cont_hist, state->cont_hist, CONT_HIST_SIZE * sizeof(short));
+        }
+        helper->cont_hist = cont_hist;
+        helper->tree_dump = NULL;
+        helper->yield_hook = NULL;
+        helper->thread_id = i + 1;
+        helper->nodes = 0;
+        helper->search_color = color;
+    }
+    for (int i = 0; i < helper_count; i++) {
+        if (thread_start(&threads[started], helper_search, &helper_states[i])) {
+            started++;
+        }
+    }
+
+    int score = iterative_search(state, color, depth_limit);
+
+    for (int i = 0; i < helper_count; i++) {
+        helper_states[i].stop = 1;
+    }
+    for (int i = 0; i < started; i++) {
+        thread_join(threads[i]);
+    }
+    return score;
+}
+
+// Helper thread of a pool: search each new generation until stopped
+void pool_helper(void* arg) {
+    HelperSlot* slot = (HelperSlot*)arg;
+    HelperPool* pool = slot->pool;
+    int seen = 0;
+
+    while (!pool->quit) {
+        int generation = pool->generation;
+        if (generation != seen) {
+            seen = generation;
+            helper_search(&helper_states[slot->index]);
+            pool->done[slot->index] = seen;
+        } else {
+#ifndef UNIVAC
+            Sleep(1);
+#elif defined(POSIX)
+            usleep(1000);
+#endif
+        }
+    }
+}
+
+// Start the helpers once, from the main thread's parameters and histories
+void helper_pool_start(HelperPool* pool, const ChessState* state) {
+    memset(pool, 0, sizeof(HelperPool));
+    for (int i = 0; i < helper_count; i++) {
+        ChessState* helper = &helper_states[i];
+        short* cont_hist = helper->cont_hist;
+
+        memcpy(helper, state, sizeof(ChessState));
+        if (cont_hist && state->cont_hist) {
+            memcpy(cont_hist, state->cont_hist, CONT_HIST_SIZE * sizeof(short));
+        }
+        helper->cont_hist = cont_hist;
+        helper->tree_dump = NULL;
+        helper->yield_hook = NULL;
+        helper->iteration_hook = NULL;
+        helper->thread_id = i + 1;
+        helper->nodes = 0;
+        helper->stop = 1;
+    }
+    for (int i = 0; i < helper_count; i++) {
+        pool->slots[i].pool = pool;
+        pool->slots[i].index = i;
+        if (!thread_start(&pool->threads[pool->started], pool_helper, &pool->slots[i])) {
+            break;
+        }
+        pool->started++;
+    }
+}
+
+// parallel_search() on a running pool: only the position is handed over,
+// and the call returns once every helper is idle again
+int helper_pool_search(HelperPool* pool, ChessState* state, int color, int depth_limit) {
+    for (int i = 0; i < pool->started; i++) {
+        ChessState* helper = &helper_states[i];
+        memcpy(helper->board, state->board, BOARD_SIZE);
+        helper->enp = state->enp;
+        helper->hash_salt = state->hash_salt;
+        helper->search_color = color;
+        helper->root_count = 0;
+        helper->nodes = 0;
+        helper->stop = 0;
+    }
+    pool->generation++;
+
+    int score = iterative_search(state, color, depth_limit);
+
+    for (int i = 0; i < pool->started; i++) {
+        helper_states[i].stop = 1;
+    }
+    for (int i = 0; i < pool->started; i++) {
+        while (pool->done[i] != pool->generation) {
+#ifndef UNIVAC
+            Sleep(1);
+#elif defined(POSIX)
+            usleep(1000);
+#endif
+        }
+    }
+    return score;
+}
+
+// Stop and join the helpers of a pool
+void helper_pool_stop(HelperPool* pool) {
+    pool->quit = 1;
+    for (int i = 0; i < pool->started; i++) {
+        thread_join(pool->threads[i]);
+    }
+    pool->started = 0;
+}
+
+// Nodes searched by the main thread and all helpers
+unsigned long long total_nodes(const ChessState* state) {
+    unsigned long long nodes = state->nodes;
+    for (int i = 0; i < helper_count; i++) {
+        nodes += helper_states[i].nodes;
+    }
+    return nodes;
+}
+
+// Standard deviation from running sums (Newton's method, no libm needed)
+double std_dev(double sum, double sum_squares, int count) {
+    double mean = sum / count;
+    double variance = sum_squares / count - mean * mean;
+    double root = variance;
+
+    if (variance <= 0.0) {
+        return 0.0;
+    }
+    for (int i = 0; i < 32; i++) {
+        root = 0.5 * (root + variance / root);
+    }
+    return root;
+}
+
+// Search with the given depth limit (capped by a limited skill level, cut
+// short by -deadline-ms) and play the best move; returns it packed as
+// from | (to << 8), or -1 when there is no move
+int engine_move(ChessState* state, int color, int depth_limit) {
+    SearchDeadline deadline;
+
+    state->stop = 0;
+    if (state->skill < SKILL_LEVELS) {
+        skill_search(state, color, depth_limit);
+    } else if (state->deadline_ms > 0) {
+        deadline_start(state, &deadline, get_time_us(), state->deadline_ms * 1000LL);
+        parallel_search(state, color, depth_limit);
+        deadline_end(state, &deadline);
+    } else {
+        parallel_search(state, color, depth_limit);
+    }
+
+    if (state->best_from < 0 || state->best_to < 0) {
+        return -1;
+    }
+    int move = state->best_from | (state->best_to << 8);
+    if (async_log) {
+        log_push(state->thread_id, LOG_MOVE, color, 0, 0, state->best_from, state->best_to, total_nodes(state));
+    }
+    make_move(state, state->best_from, state->best_to);
+    return move;
+}
+
+// Execute computer move (lines 99-103). With -deadline-ms the search
+// deepens until the deadline instead of stopping at 3 plies.
+void computer_move(ChessState* state, int color) {
+    int move = engine_move(state, color, state->deadline_ms > 0 ? ANALYSIS_MAX_DEPTH * 2 : MAX_DEPTH_PLY0);
+
+    // Display the move played
+    if (move >= 0) {
+        char from_str[3], to_str[3];
+        position_to_algebraic(move & 0xFF, from_str);
+        position_to_algebraic(move >> 8, to_str);
+        printf("%s%s\n", from_str, to_str);
+    }
+}
+
+// Make a move on the board
+void make_move(ChessState* state, int from, int to) {
+    unsigned char piece = state->board[from];
+    unsigned char captured = state->board[to];
+
+    // Clear moved bit when moving
+    state->board[to] = piece & PIECE_FULL_MASK;
+    state->board[from] = EMPTY;
+
+    // Handle special moves (castling, en passant, promotion)
+    int piece_type = get_piece_type(piece);
+
+    // Check for pawn promotion
+    if (piece_type == PAWN) {
+        if ((to & 0xF0) == 0x00 || (to & 0xF0) == 0x70) {
+            // Promote to queen
+            state->board[to] = (piece & COLOR_MASK) | QUEEN;
+        }
+
+        // Check for en passant capture
+        int diff = to - from;
+        if ((diff & 0x0F) > 1 || (diff & 0x0F) < -1) {
+            // Diagonal move
+            if (captured == EMPTY && to == state->enp) {
+                // En passant: remove captured pawn
+                int ep_pawn_square;
+                if (diff > 0) {
+                    ep_pawn_square = to - 16;  // White captured black
+                } else {
+                    ep_pawn_square = to + 16;  // Black captured white
+                }
+                state->board[ep_pawn_square] = EMPTY;
+            }
+        }
+
+        // Set en passant target if pawn moved two squares
+        if (diff == 32 || diff == -32) {
+            state->enp = to;
+        } else {
+            state->enp = 0;
+        }
+    } else {
+        state->enp = 0;
+    }
+
+    // Handle castling
+    if (piece_type == KING) {
+        int diff = to - from;
+        if (diff == 2) {
+            // Castle kingside
+            state->board[to - 1] = state->board[to + 1];
+            state->board[to + 1] = EMPTY;
+        } else if (diff == -2) {
+            // Castle queenside
+            state->board[to + 1] = state->board[to - 2];
+            state->board[to - 2] = EMPTY;
+        }
+    }
+}
+
+// Main game loop (lines 88-103), returns when the player quits
+void run_game(ChessState* state) {
+    while (1) {
+        // Display board
+        display_board(state);
+
+        // Get player move
+        printf("\nYour move (e.g., D2D4 or 'q' to exit): ");
+
+        // Read first character WITHOUT masking to check for quit command
+#ifdef UNIVAC
+        int first_char_raw = getchar();
+#else
+        int first_char_raw = _getch();
+        putchar(first_char_raw);  // Echo the character
+#endif
+        char first_upper = (char)toupper(first_char_raw);
+
+        // Check for 'Q' (quit)
+        if (first_upper == 'Q') {
+            printf("\nThanks for playing!\n");
+            return;
+        }
+
+        // "tt save <file>" / "tt load <file>" hash table commands
+        if (first_upper == 'T') {
+            char line[300] = "t";
+            if (fgets(line + 1, sizeof(line) - 1, stdin) == NULL) {
+                return;
+            }
+            printf("%s\n", tt_command(line, state->tt_mmap) ? "Done." : "Hash table command failed.");
+            continue;
+        }
+
+        // Apply masking for chess coordinate processing
+        int from_col = first_char_raw & 0x0F;
+        int from_row = read_key();
+        int to_col = read_key();
+        int to_row = read_key();
+
+        // Calculate board positions from coordinates
+        int from = (from_col + 127) - (from_row << 4);
+        int to = (to_col + 127) - (to_row << 4);
+        printf("\n");
+
+        // Validate player move (WHITE)
+        if (!move_is_legal(state, from, to, WHITE)) {
+            printf("Illegal move! Try again.\n");
+            continue;
+        }
+
+        // Execute player move
+        if (async_log) {
+            log_push(state->thread_id, LOG_MOVE, WHITE, 0, 0, from, to, 0);
+        }
+        make_move(state, from, to);
+
+        // Display board after player move
+        display_board(state);
+        printf("\nComputer thinking...");
+
+        // Computer move (BLACK)
         computer_move(state, BLACK);
+        log_poll();
+    }
+}
+
+// Monotonic-enough millisecond clock for benchmarks
+long long get_time_ms(void) {
+#ifndef UNIVAC
+    return (long long)GetTickCount64();
+#elif defined(POSIX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+    return (long long)clock() * 1000 / CLOCKS_PER_SEC;
+#endif
+}
+
+// Microsecond clock for timing short searches
+long long get_time_us(void) {
+#ifndef UNIVAC
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (long long)(counter.QuadPart / frequency.QuadPart * 1000000
+                       + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#elif defined(POSIX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return (long long)clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+// Thread start arguments (the platform entry point signatures differ)
+typedef struct {
+    thread_func func;
+    void* arg;
+} ThreadStart;
+
+#ifndef UNIVAC
+DWORD WINAPI thread_entry(LPVOID param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+#elif defined(POSIX)
+void* thread_entry(void* param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return NULL;
+}
+#endif
+
+// Start a thread; returns 1 if it must later be joined
+int thread_start(thread_handle* thread, thread_func func, void* arg) {
+#if !defined(UNIVAC) || defined(POSIX)
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) {
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+#ifndef UNIVAC
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return 0;
+    }
+#else
+    if (pthread_create(thread, NULL, thread_entry, start) != 0) {
+        free(start);
+        return 0;
+    }
+#endif
+    return 1;
+#else
+    *thread = 0;
+    func(arg);
+    return 0;
+#endif
+}
+
+// Wait for a thread started by thread_start()
+void thread_join(thread_handle thread) {
+#ifndef UNIVAC
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#elif defined(POSIX)
+    pthread_join(thread, NULL);
+#else
+    (void)thread;
+#endif
+}
+
+// Mutexes for the few places threads share more than the hash table
+void mutex_init(mutex_handle* mutex) {
+#ifndef UNIVAC
+    InitializeCriticalSection(mutex);
+#elif defined(POSIX)
+    pthread_mutex_init(mutex, NULL);
+#else
+    *mutex = 0;
+#endif
+}
+
+void mutex_lock(mutex_handle* mutex) {
+#ifndef UNIVAC
+    EnterCriticalSection(mutex);
+#elif defined(POSIX)
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void mutex_unlock(mutex_handle* mutex) {
+#ifndef UNIVAC
+    LeaveCriticalSection(mutex);
+#elif defined(POSIX)
+    pthread_mutex_unlock(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void mutex_destroy(mutex_handle* mutex) {
+#ifndef UNIVAC
+    DeleteCriticalSection(mutex);
+#elif defined(POSIX)
+    pthread_mutex_destroy(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+// Number of processors available to this process
+int cpu_count(void) {
+#ifndef UNIVAC
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#elif defined(POSIX)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+// Benchmark positions (start position, open middlegames and endgames)
+static const char* const bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R b KQ - 0 8",
+    "2r3k1/pp3ppp/2n1b3/3p4/3P4/2PB1N2/P4PPP/R5K1 b - - 0 20",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+#define BENCH_POSITION_COUNT ((int)(sizeof(bench_positions) / sizeof(bench_positions[0])))
+
+// Search every benchmark position to the given depth (in plies, default 3)
+// and report nodes to each depth, first-move cutoff rate and speed
+void run_bench(ChessState* state, int depth) {
+    unsigned long long total_nodes = 0;
+    unsigned long long total_cutoffs = 0;
+    unsigned long long total_first = 0;
+    unsigned long long total_probcut = 0;
+
+    if (depth <= 0) {
+        depth = MAX_DEPTH_PLY0 / 2;
+    }
+
+    clear_search_tables(state);
+    if (!state->tt_load_file) {
+        tt_clear();  // A loaded table is kept to measure warm starts
+    }
+    long long start = get_time_ms();
+
+    for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+        int color = load_fen(state, bench_positions[i]);
+        char from_str[3] = "--", to_str[3] = "--";
+
+        state->nodes = state->cutoffs = state->first_move_cutoffs = state->probcut_cutoffs = state->tt_hits = 0;
+        printf("Position %d/%d:", i + 1, BENCH_POSITION_COUNT);
+
+        // Iterative deepening so nodes to each depth can be compared
+        for (int d = 1; d <= depth; d++) {
+            search_position(state, color, d * 2);
+            printf(" d%d=%llu", d, state->nodes);
+        }
+
+        if (state->best_from >= 0) {
+            position_to_algebraic(state->best_from, from_str);
+            position_to_algebraic(state->best_to, to_str);
+        }
+        printf(" best %s%s\n", from_str, to_str);
+
+        total_nodes += state->nodes;
+        total_cutoffs += state->cutoffs;
+        total_first += state->first_move_cutoffs;
+        total_probcut += state->probcut_cutoffs;
+    }
+
+    long long elapsed = get_time_ms() - start;
+
+    printf("\n===========================\n");
+    printf("Total time (ms) : %lld\n", elapsed);
+    printf("Nodes searched  : %llu\n", total_nodes);
+    printf("Nodes/second    : %llu\n", total_nodes * 1000 / (unsigned long long)(elapsed > 0 ? elapsed : 1));
+    printf("First-move cuts : %.1f%%\n",
+           total_cutoffs ? 100.0 * (double)total_first / (double)total_cutoffs : 0.0);
+    printf("ProbCut cutoffs : %llu\n", total_probcut);
+    printf("Kernel          : %s\n", kernel_names[kernel_variant]);
+
+    // Same workload with every kernel variant this CPU supports
+    int selected = kernel_variant;
+    for (int v = 0; v < KERNEL_COUNT; v++) {
+        if (!cpu_supports_kernel(v) || (v == KERNEL_SCALAR && !cpu_supports_kernel(KERNEL_SSE2))) {
+            continue;  // Nothing to compare against
+        }
+        unsigned long long nodes = 0;
+        set_kernel(v);
+        clear_search_tables(state);
+        if (!state->tt_load_file) {
+            tt_clear();
+        }
+        start = get_time_ms();
+        for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+            int color = load_fen(state, bench_positions[i]);
+            state->nodes = 0;
+            for (int d = 1; d <= depth; d++) {
+                search_position(state, color, d * 2);
+            }
+            nodes += state->nodes;
+        }
+        elapsed = get_time_ms() - start;
+        printf("  %-14s: %llu nodes/second%s\n", kernel_names[v],
+               nodes * 1000 / (unsigned long long)(elapsed > 0 ? elapsed : 1),
+               nodes == total_nodes || state->tt_load_file ? "" : " (NODE COUNT DIFFERS)");
+    }
+    set_kernel(selected);
+}
+
+// Thread scaling: run the bench positions at 1, 2, 4 ... max_threads
+// threads, repeats times each, and print CSV with the mean and standard
+// deviation of time to depth, the speedup and NPS scaling against one
+// thread, and the search overhead (extra nodes) of the parallel search.
+void run_scaling(ChessState* state, int max_threads, int depth, int repeats) {
+    double base_time = 0.0;
+    double base_nps = 0.0;
+    double base_nodes = 0.0;
+
+    if (max_threads <= 0) {
+        max_threads = cpu_count();
+    }
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+    if (depth <= 0) {
+        depth = MAX_DEPTH_PLY0 / 2 + 3;
+    }
+    if (repeats <= 0) {
+        repeats = SCALING_REPEATS;
+    }
+
+    printf("threads,runs,time_ms,time_sd,speedup,nodes,overhead_pct,nps,nps_sd,nps_scaling\n");
+
+    for (int threads = 1; ; ) {
+        double sum_time = 0.0, sum_time2 = 0.0;
+        double sum_nps = 0.0, sum_nps2 = 0.0;
+        double sum_nodes = 0.0;
+
+        state->threads = threads;
+        if (apply_memory_budget(state, state->memory_kb) == 0) {
+            printf("# out of memory at %d threads\n", threads);
+            return;
+        }
+
+        for (int run = 0; run < repeats; run++) {
+            unsigned long long nodes = 0;
+
+            clear_search_tables(state);
+            tt_clear();
+            long long start = get_time_ms();
+
+            for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+                int color = load_fen(state, bench_positions[i]);
+                state->nodes = 0;
+                state->stop = 0;
+                parallel_search(state, color, depth * 2);
+                nodes += total_nodes(state);
+            }
+
+            double elapsed = (double)(get_time_ms() - start);
+            double nps = (double)nodes * 1000.0 / (elapsed > 0 ? elapsed : 1.0);
+            sum_time += elapsed;
+            sum_time2 += elapsed * elapsed;
+            sum_nps += nps;
+            sum_nps2 += nps * nps;
+            sum_nodes += (double)nodes;
+        }
+
+        double mean_time = sum_time / repeats;
+        double mean_nps = sum_nps / repeats;
+        double mean_nodes = sum_nodes / repeats;
+
+        if (threads == 1) {
+            base_time = mean_time;
+            base_nps = mean_nps;
+            base_nodes = mean_nodes;
+        }
+
+        printf("%d,%d,%.1f,%.1f,%.3f,%.0f,%.1f,%.0f,%.0f,%.3f\n",
+               threads, repeats, mean_time, std_dev(sum_time, sum_time2, repeats),
+               mean_time > 0 ? base_time / mean_time : 0.0,
+               mean_nodes, base_nodes > 0 ? 100.0 * (mean_nodes / base_nodes - 1.0) : 0.0,
+               mean_nps, std_dev(sum_nps, sum_nps2, repeats),
+               base_nps > 0 ? mean_nps / base_nps : 0.0);
+        fflush(stdout);
+
+        if (threads == max_threads) {
+            break;
+        }
+        // Double, ending on max_threads itself
+        threads = threads * 2 > max_threads ? max_threads : threads * 2;
+    }
+}
+
+// Process scaling: 1, 2, 4 ... processes each search the bench positions
+// (starting at different positions, so they work on related but distinct
+// trees), once with private tables and once attached to one shared table.
+// Prints CSV with wall time, total nodes and aggregate NPS.
+void run_process_scaling(ChessState* state, int max_processes, int depth) {
+#if defined(UNIVAC) && defined(POSIX)
+    char name[64];
+
+    if (max_processes <= 0) {
+        max_processes = cpu_count();
+    }
+    if (depth <= 0) {
+        depth = MAX_DEPTH_PLY0 / 2 + 3;
+    }
+    snprintf(name, sizeof(name), "atomchess_bench_%d", (int)getpid());
+
+    // Children create or attach to the segment themselves
+    tt_free();
+    printf("processes,shared,time_ms,nodes,nps\n");
+
+    for (int processes = 1; ; processes = (processes * 2 > max_processes) ? max_processes : processes * 2) {
+        for (int shared = 0; shared <= 1; shared++) {
+            int pipes[2];
+            unsigned long long nodes = 0;
+
+            if (pipe(pipes) != 0) {
+                return;
+            }
+            fflush(stdout);
+            long long start = get_time_ms();
+
+            for (int p = 0; p < processes; p++) {
+                if (fork() == 0) {
+                    unsigned long long child_nodes = 0;
+
+                    close(pipes[0]);
+                    state->tree_dump = NULL;    // The parent owns the dump
+                    state->tt_shared_name = shared ? name : NULL;
+                    if (apply_memory_budget(state, state->memory_kb) == 0) {
+                        _exit(1);
+                    }
+                    clear_search_tables(state);
+                    for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+                        int color = load_fen(state, bench_positions[(i + p) % BENCH_POSITION_COUNT]);
+                        state->nodes = 0;
+                        state->stop = 0;
+                        parallel_search(state, color, depth * 2);
+                        child_nodes += total_nodes(state);
+                    }
+                    tt_free();
+                    if (write(pipes[1], &child_nodes, sizeof(child_nodes)) != sizeof(child_nodes)) {
+                        _exit(1);
+                    }
+                    _exit(0);
+                }
+            }
+
+            close(pipes[1]);
+            for (int p = 0; p < processes; p++) {
+                unsigned long long child_nodes;
+                if (read(pipes[0], &child_nodes, sizeof(child_nodes)) == sizeof(child_nodes)) {
+                    nodes += child_nodes;
+                }
+            }
+            close(pipes[0]);
+            while (wait(NULL) > 0) {
+            }
+
+            long long elapsed = get_time_ms() - start;
+            printf("%d,%d,%lld,%llu,%llu\n", processes, shared, elapsed, nodes,
+                   nodes * 1000 / (unsigned long long)(elapsed > 0 ? elapsed : 1));
+            fflush(stdout);
+        }
+        if (processes >= max_processes) {
+            break;
+        }
+    }
+#else
+    (void)state;
+    (void)max_processes;
+    (void)depth;
+    printf("Process benchmark needs a -DPOSIX build; start several engines with -tt-shared instead\n");
+#endif
+}
+
+// Parse a coordinate move such as "D2D4", "e2e4", "e2-e4" or "g1xf3"
+// Returns 1 and the 0x88 squares, or 0 if the token is not a move
+int parse_coordinate_move(const char* token, int* from, int* to) {
+    int from_col = tolower((unsigned char)token[0]) - 'a';
+    int from_rank = token[1] - '1';
+    int skip = (token[2] == '-' || token[2] == 'x' || token[2] == 'X') ? 1 : 0;
+    int to_col = tolower((unsigned char)token[2 + skip]) - 'a';
+    int to_rank = token[3 + skip] - '1';
+
+    if (from_col < 0 || from_col > 7 || from_rank < 0 || from_rank > 7
+        || to_col < 0 || to_col > 7 || to_rank < 0 || to_rank > 7) {
+        return 0;
+    }
+    *from = (7 - from_rank) * 16 + from_col;
+    *to = (7 - to_rank) * 16 + to_col;
+    return 1;
+}
+
+// Append an empty game to a growing array; returns NULL when out of memory
+AnnotatedGame* add_game(AnnotatedGame** games, int* count, int* capacity) {
+    if (*count == *capacity) {
+        int grown_capacity = *capacity ? *capacity * 2 : 16;
+        AnnotatedGame* grown = (AnnotatedGame*)realloc(*games, (size_t)grown_capacity * sizeof(AnnotatedGame));
+        if (!grown) {
+            return NULL;
+        }
+        *games = grown;
+        *capacity = grown_capacity;
+    }
+    memset(&(*games)[*count], 0, sizeof(AnnotatedGame));
+    return &(*games)[(*count)++];
+}
+
+// Read every game of a PGN file. Each game is replayed on state while it
+// is read, so moves may be in SAN (Nf3, exd5, O-O) or in the coordinate
+// notation computer_move() prints. Tags other than FEN, comments, NAGs,
+// move numbers and results are skipped. A move that cannot be read is
+// reported and ends that game's movetext. Returns the number of games.
+int read_pgn_games(ChessState* state, const char* path, AnnotatedGame** games) {
+    FILE* file = fopen(path, "r");
+    AnnotatedGame* game = NULL;
+    int count = 0;
+    int capacity = 0;
+    int in_tags = 0;    // Current game has only seen tags so far
+    int color = WHITE;  // Side to move in the replayed game
+    int broken = 0;     // Rest of the current game's movetext is skipped
+    char token[128];
+    int c;
+
+    *games = NULL;
+    if (!file) {
+        return 0;
+    }
+
+    while ((c = fgetc(file)) != EOF) {
+        if (isspace(c)) {
+            continue;
+        }
+        // Comments and tag pairs
+        if (c == '{' || c == ';' || c == '[') {
+            int end = (c == '{') ? '}' : (c == ';') ? '\n' : ']';
+            int len = 0;
+            while ((c = fgetc(file)) != EOF && c != end) {
+                if (len < (int)sizeof(token) - 1) {
+                    token[len++] = (char)c;
+                }
+            }
+            token[len] = '\0';
+            if (end == ']') {
+                // The first tag after movetext starts the next game
+                if (!in_tags) {
+                    if ((game = add_game(games, &count, &capacity)) == NULL) {
+                        break;
+                    }
+                    in_tags = 1;
+                    broken = 0;
+                }
+                if (strncmp(token, "FEN \"", 5) == 0) {
+                    char* quote = strchr(token + 5, '"');
+                    if (quote) {
+                        *quote = '\0';
+                    }
+                    snprintf(game->fen, sizeof(game->fen), "%s", token + 5);
+                }
+            }
+            continue;
+        }
+
+        // Movetext token
+        int len = 0;
+        token[len++] = (char)c;
+        while ((c = fgetc(file)) != EOF && !isspace(c) && c != '{' && c != '[' && c != ';') {
+            if (len < (int)sizeof(token) - 1) {
+                token[len++] = (char)c;
+            }
+        }
+        token[len] = '\0';
+        if (c != EOF && !isspace(c)) {
+            ungetc(c, file);
+        }
+
+        // Skip a leading move number ("12." or "12...")
+        const char* move = token;
+        while (isdigit((unsigned char)*move)) move++;
+        while (*move == '.') move++;
+        if (move != token && move[-1] != '.') {
+            move = token;  // Result such as 1-0: not a numbered move
+        }
+
+        int from, to;
+        if (strcmp(token, "1-0") == 0 || strcmp(token, "0-1") == 0
+            || strcmp(token, "1/2-1/2") == 0 || strcmp(token, "*") == 0) {
+            game = NULL;  // Game over: the next tag or move starts another
+            in_tags = 0;
+            broken = 0;
+            continue;
+        }
+        if (*move == '\0' || *move == '$' || broken) {
+            continue;     // Bare move number, NAG, or past an unreadable move
+        }
+        // Movetext without tags starts a new game too
+        if (game == NULL) {
+            if ((game = add_game(games, &count, &capacity)) == NULL) {
+                break;
+            }
+            broken = 0;
+        }
+        if (game->move_count == 0) {
+            color = setup_game_position(state, game, 0);
+        }
+        in_tags = 0;
+        if (!parse_san_move(state, color, move, &from, &to)) {
+            printf("Game %d: cannot read move %d \"%s\", rest of the game skipped\n",
+                   count, game->move_count + 1, move);
+            broken = 1;
+            continue;
+        }
+        if (game->move_count < MAX_GAME_MOVES) {
+            game->from[game->move_count] = (unsigned char)from;
+            game->to[game->move_count] = (unsigned char)to;
+            game->move_count++;
+            make_move(state, from, to);
+            color ^= COLOR_MASK;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Set up the position before the given ply; returns the side to move
+int setup_game_position(ChessState* state, const AnnotatedGame* game, int ply) {
+    int color = WHITE;
+
+    if (game->fen[0]) {
+        color = load_fen(state, game->fen);
+        if (color < 0) {
+            color = WHITE;
+        }
+    } else {
+        init_chess(state);
+    }
+    for (int i = 0; i < ply; i++) {
+        make_move(state, game->from[i], game->to[i]);
+        color ^= COLOR_MASK;
+    }
+    return color;
+}
+
+// Annotate one game: the engine's best move and score in every position,
+// and the score of the move actually played searched one ply shallower
+// after it. Tables carry over from position to position unless independent:
+// then each position clears this thread's histories and searches under its
+// own hash salt, which hides every other position's hash entries without
+// clearing the table the other workers share.
+void annotate_game(ChessState* state, AnnotatedGame* game, int depth, int backward, int independent) {
+    for (int n = 0; n < game->move_count; n++) {
+        int ply = backward ? game->move_count - 1 - n : n;
+        int color = setup_game_position(state, game, ply);
+        int from = game->from[ply];
+        int to = game->to[ply];
+
+        if (independent) {
+            state->hash_salt = next_salt((unsigned long long)(size_t)game * MAX_GAME_MOVES + (unsigned long long)ply);
+            clear_search_tables(state);
+        }
+
+        state->stop = 0;
+        game->best_score[ply] = iterative_search(state, color, depth * 2);
+        game->best_from[ply] = (unsigned char)(state->best_from < 0 ? 0 : state->best_from);
+        game->best_to[ply] = (unsigned char)(state->best_to < 0 ? 0 : state->best_to);
+
+        if (state->best_from == from && state->best_to == to) {
+            game->played_score[ply] = game->best_score[ply];
+        } else {
+            int captured = piece_scores[get_piece_type(state->board[to])];
+            if (get_piece_type(state->board[to]) == KING) {
+                game->played_score[ply] = MAX_CHECKMATE_SCORE;
+            } else {
+                make_move(state, from, to);
+                game->played_score[ply] = captured
+                    - (depth > 1 ? search_position(state, color ^ COLOR_MASK, depth * 2 - 2) : 0);
+            }
+        }
+    }
+}
+
+// Worker thread: annotate games until none are left
+void annotate_worker(void* arg) {
+    AnnotateWorker* worker = (AnnotateWorker*)arg;
+    AnnotateJob* job = worker->job;
+
+    for (;;) {
+        int index = ATOMIC_FETCH_ADD(&job->next_game, 1);
+        if (index >= job->game_count) {
+            break;
+        }
+        annotate_game(worker->state, &job->games[index], job->depth, job->backward, job->independent);
+    }
+}
+
+// Annotate all games of a job on the main state plus every helper state;
+// returns the wall time in milliseconds
+long long annotate_games(ChessState* state, AnnotateJob* job) {
+    AnnotateWorker workers[MAX_THREADS];
+    thread_handle threads[MAX_THREADS];
+    int started = 0;
+    int worker_count = 1 + helper_count;
+
+    clear_search_tables(state);
+    tt_clear();
+    job->next_game = 0;
+    long long start = get_time_ms();
+
+    for (int i = 0; i < worker_count; i++) {
+        ChessState* worker_state = (i == 0) ? state : &helper_states[i - 1];
+        if (i > 0) {
+            short* cont_hist = worker_state->cont_hist;
+            memcpy(worker_state, state, sizeof(ChessState));
+            worker_state->cont_hist = cont_hist;
+            worker_state->tree_dump = NULL;
+            worker_state->thread_id = i;
+        }
+        workers[i].job = job;
+        workers[i].state = worker_state;
+    }
+    for (int i = 1; i < worker_count; i++) {
+        if (thread_start(&threads[started], annotate_worker, &workers[i])) {
+            started++;
+        }
+    }
+    annotate_worker(&workers[0]);
+    for (int i = 0; i < started; i++) {
+        thread_join(threads[i]);
+    }
+    state->hash_salt = 0;
+
+    return get_time_ms() - start;
+}
+
+// Annotate every game of a PGN file and print per-move evaluations, best
+// alternatives and blunder flags, then compare the whole-game run (shared
+// tables, games in parallel) against independent per-position analysis.
+void run_annotate(ChessState* state, const char* path, int depth, int backward) {
+    AnnotateJob job;
+    int positions = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.game_count = read_pgn_games(state, path, &job.games);
+    job.depth = depth > 0 ? depth : ANNOTATE_DEPTH;
+    job.backward = backward;
+    if (job.game_count == 0) {
+        printf("No games found in %s\n", path);
+        free(job.games);
+        return;
+    }
+    for (int g = 0; g < job.game_count; g++) {
+        if (job.games[g].move_count == 0) {
+            printf("Game %d has no moves\n", g + 1);
+        }
+        positions += job.games[g].move_count;
+    }
+    if (positions == 0) {
+        printf("No moves to annotate in %s\n", path);
+        free(job.games);
+        return;
+    }
+    positions = 0;
+
+    long long elapsed = annotate_games(state, &job);
+
+    for (int g = 0; g < job.game_count; g++) {
+        AnnotatedGame* game = &job.games[g];
+        int color = game->fen[0] ? setup_game_position(state, game, 0) : WHITE;
+
+        printf("Game %d (%d plies)\n", g + 1, game->move_count);
+        for (int ply = 0; ply < game->move_count; ply++) {
+            char played[5], best[5];
+            position_to_algebraic(game->from[ply], played);
+            position_to_algebraic(game->to[ply], played + 2);
+            position_to_algebraic(game->best_from[ply], best);
+            position_to_algebraic(game->best_to[ply], best + 2);
+            int loss = game->best_score[ply] - game->played_score[ply];
+
+            printf("%4d%s %s %+5d  best %s %+5d%s\n", ply / 2 + 1, color == WHITE ? ". " : "...",
+                   played, game->played_score[ply], best, game->best_score[ply],
+                   loss >= ANNOTATE_BLUNDER_MARGIN ? "  ??" : "");
+            color ^= COLOR_MASK;
+        }
+        positions += game->move_count;
+    }
+
+    job.independent = 1;
+    long long independent = annotate_games(state, &job);
+
+    printf("\nAnnotated %d games, %d positions at depth %d (%s)\n",
+           job.game_count, positions, job.depth, backward ? "backward" : "forward");
+    printf("Whole game, %d threads : %lld ms\n", 1 + helper_count, elapsed);
+    printf("Independent, %d threads: %lld ms\n", 1 + helper_count, independent);
+    printf("Speedup                : %.2f\n", elapsed > 0 ? (double)independent / (double)elapsed : 0.0);
+
+    free(job.games);
+}
+
+// Reroot the search at the newest queued position
+void session_apply_updates(AnalysisSession* session) {
+    ChessState* state = session->state;
+
+    mutex_lock(&session->lock);
+    memcpy(state->board, session->queued_board, BOARD_SIZE);
+    state->enp = session->queued_enp;
+    session->color = session->queued_color;
+    session->pending = 0;
+    state->stop = 0;
+    state->nodes = 0;
+    session->reroot_time = get_time_ms();
+    session->first_info = 1;
+    mutex_unlock(&session->lock);
+}
+
+// Iteration hook: stream throttled info lines. The first completed depth
+// after an update is always shown with its latency from the update, and
+// synchronous sessions show every depth.
+void session_info(void* context, int depth, int score) {
+    AnalysisSession* session = (AnalysisSession*)context;
+    ChessState* state = session->state;
+    long long now = get_time_ms();
+    char from_str[3], to_str[3];
+
+    if (session->threaded && !session->first_info && now - session->last_info < ANALYSIS_INFO_MS) {
+        return;
+    }
+    position_to_algebraic(state->best_from, from_str);
+    position_to_algebraic(state->best_to, to_str);
+    printf("info depth %d score %d nodes %llu time %lld pv %s%s%s\n", depth, score,
+           total_nodes(state), now - session->reroot_time, from_str, to_str,
+           session->first_info ? " (first after update)" : "");
+    fflush(stdout);
+    session->first_info = 0;
+    session->last_info = now;
+}
+
+// Search thread: deepen until an update arrives, then reroot and go on
+// with the same hash table and histories, in this thread and the helpers
+void session_thread(void* arg) {
+    AnalysisSession* session = (AnalysisSession*)arg;
+
+    helper_pool_start(&session->pool, session->state);
+    while (!session->quit) {
+        session_apply_updates(session);
+        if (session->pending) {
+            continue;  // Another update arrived while applying
+        }
+        helper_pool_search(&session->pool, session->state, session->color, ANALYSIS_MAX_DEPTH * 2);
+        // Fully searched: wait for the next update
+        while (!session->pending && !session->quit) {
+#ifndef UNIVAC
+            Sleep(1);
+#elif defined(POSIX)
+            usleep(1000);
+#endif
+        }
+    }
+    helper_pool_stop(&session->pool);
+}
+
+// Start analysing the state's position. On builds without threads the
+// session searches synchronously to a fixed depth after every update.
+int session_start(AnalysisSession* session, ChessState* state, int color) {
+    memset(session, 0, sizeof(AnalysisSession));
+    session->front = (ChessState*)malloc(sizeof(ChessState));
+    if (!session->front) {
+        return 0;
+    }
+    // The front copy only checks moves: no tables, hooks or dump
+    memcpy(session->front, state, sizeof(ChessState));
+    session->front->cont_hist = NULL;
+    session->front->tree_dump = NULL;
+    session->front->yield_hook = NULL;
+    session->front->iteration_hook = NULL;
+    session->front_color = color;
+    session->state = state;
+    mutex_init(&session->lock);
+    state->iteration_hook = session_info;
+    state->hook_context = session;
+    memcpy(session->queued_board, state->board, BOARD_SIZE);
+    session->queued_enp = state->enp;
+    session->queued_color = color;
+    session->pending = 1;
+
+    if (MAX_THREADS == 1) {
+        session_apply_updates(session);
+        parallel_search(state, session->color, ANALYSIS_SYNC_DEPTH * 2);
+        return 1;
+    }
+    session->threaded = thread_start(&session->thread, session_thread, session);
+    return session->threaded;
+}
+
+// Queue the front position and abort the running iteration so the search
+// reroots at once
+void session_queue_position(AnalysisSession* session) {
+    mutex_lock(&session->lock);
+    memcpy(session->queued_board, session->front->board, BOARD_SIZE);
+    session->queued_enp = session->front->enp;
+    session->queued_color = session->front_color;
+    session->pending = 1;
+    session->state->stop = 1;
+    mutex_unlock(&session->lock);
+
+    if (!session->threaded) {
+        session_apply_updates(session);
+        parallel_search(session->state, session->color, ANALYSIS_SYNC_DEPTH * 2);
+    }
+}
+
+// A move was played in the analysed position; returns 0, queueing
+// nothing, if it is illegal there or the game is full
+int session_push_move(AnalysisSession* session, int from, int to) {
+    ChessState* front = session->front;
+
+    if (session->ply >= MAX_GAME_MOVES || !move_is_legal(front, from, to, session->front_color)) {
+        return 0;
+    }
+    memcpy(session->boards[session->ply], front->board, BOARD_SIZE);
+    session->enps[session->ply] = front->enp;
+    session->ply++;
+    make_move(front, from, to);
+    session->front_color ^= COLOR_MASK;
+    session_queue_position(session);
+    return 1;
+}
+
+// The last move was taken back; returns 0 if there was none
+int session_takeback(AnalysisSession* session) {
+    if (session->ply == 0) {
+        return 0;
+    }
+    session->ply--;
+    memcpy(session->front->board, session->boards[session->ply], BOARD_SIZE);
+    session->front->enp = session->enps[session->ply];
+    session->front_color ^= COLOR_MASK;
+    session_queue_position(session);
+    return 1;
+}
+
+// Stop the search thread and release the session
+void session_stop(AnalysisSession* session) {
+    session->quit = 1;
+    session->state->stop = 1;
+    if (session->threaded) {
+        thread_join(session->thread);
+    }
+    session->state->iteration_hook = NULL;
+    free(session->front);
+    session->front = NULL;
+    mutex_destroy(&session->lock);
+}
+
+// Analysis front end: one command per line on stdin, either a coordinate
+// move (e2e4), "undo" to take the last move back, or "quit"
+void run_analysis(ChessState* state) {
+    static AnalysisSession session;
+    char line[128];
+
+    init_chess(state);
+    clear_search_tables(state);
+    if (!session_start(&session, state, WHITE)) {
+        printf("Cannot start the analysis thread\n");
+        return;
+    }
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        int from, to;
+        if (strncmp(line, "quit", 4) == 0) {
+            break;
+        } else if (strncmp(line, "undo", 4) == 0) {
+            if (!session_takeback(&session)) {
+                printf("Nothing to take back\n");
+            }
+        } else if (parse_coordinate_move(line, &from, &to)) {
+            if (!session_push_move(&session, from, to)) {
+                printf("Illegal move: %s", line);
+            }
+        } else if (line[0] != '\n') {
+            printf("Unknown command: %s", line);
+        }
+    }
+
+    session_stop(&session);
+}
+
+// Follow hash moves from the current position; returns the PV length
+int extract_pv(ChessState* state, int color, Move* pv, int max_length) {
+    unsigned char saved_board[BOARD_SIZE];
+    unsigned long long saved_hash = state->hash;
+    int length = 0;
+
+    memcpy(saved_board, state->board, BOARD_SIZE);
+    state->hash = compute_hash(state) ^ state->hash_salt;
+
+    while (length < max_length) {
+        int move, depth, bound, score;
+        if (!tt_probe(state->hash ^ (color ? zobrist_side : 0), &move, &depth, &bound, &score) || move == 0) {
+            break;
+        }
+        int from = move & 0xFF;
+        int to = move >> 8;
+        unsigned char piece = state->board[from];
+        if ((from & 0x88) || (to & 0x88) || piece == EMPTY || get_piece_color(piece) != color) {
+            break;
+        }
+        pv[length].from = (unsigned char)from;
+        pv[length].to = (unsigned char)to;
+        pv[length].score = score;
+        length++;
+
+        state->hash ^= zobrist_keys[piece & PIECE_FULL_MASK][from]
+                     ^ zobrist_keys[piece & PIECE_FULL_MASK][to]
+                     ^ zobrist_keys[state->board[to] & PIECE_FULL_MASK][to];
+        state->board[to] = piece & PIECE_FULL_MASK;
+        state->board[from] = EMPTY;
+        color ^= COLOR_MASK;
+    }
+
+    memcpy(state->board, saved_board, BOARD_SIZE);
+    state->hash = saved_hash;
+    return length;
+}
+
+// Write the iteration state and a hash table snapshot. Both go to
+// temporary files first, so a crash mid-write keeps the last checkpoint.
+// The snapshot goes to the slot the run did not resume from: that one may
+// still be mapped as the live table, and Windows cannot replace a mapped
+// file. The checkpoint is renamed last and names the new slot.
+int save_checkpoint(DeepSearch* deep, int depth, int score) {
+    static SearchCheckpoint checkpoint;
+    ChessState* state = deep->state;
+    char temp_path[300], tt_path[300], tt_temp_path[300];
+
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    memcpy(checkpoint.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    checkpoint.version = CHECKPOINT_VERSION;
+    checkpoint.color = deep->color;
+    memcpy(checkpoint.board, state->board, BOARD_SIZE);
+    checkpoint.enp = state->enp;
+    checkpoint.completed_depth = depth;
+    checkpoint.score = score;
+    checkpoint.best_from = state->best_from;
+    checkpoint.best_to = state->best_to;
+    checkpoint.pv_length = extract_pv(state, deep->color, checkpoint.pv, MAX_PLY);
+    checkpoint.root_count = state->root_count;
+    memcpy(checkpoint.root_moves, state->root_moves, sizeof(checkpoint.root_moves));
+    checkpoint.nodes = deep->previous_nodes + total_nodes(state);
+    checkpoint.elapsed_ms = deep->previous_elapsed + get_time_ms() - deep->start;
+    checkpoint.tt_slot = deep->tt_slot ^ 1;
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", deep->path);
+    snprintf(tt_path, sizeof(tt_path), "%s.tt%d", deep->path, checkpoint.tt_slot);
+    snprintf(tt_temp_path, sizeof(tt_temp_path), "%s.tt%d.tmp", deep->path, checkpoint.tt_slot);
+
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = fwrite(&checkpoint, sizeof(checkpoint), 1, file) == 1;
+    ok = (fclose(file) == 0) && ok && tt_save(tt_temp_path);
+    if (!ok) {
+        return 0;
+    }
+#ifndef UNIVAC
+    return MoveFileExA(tt_temp_path, tt_path, MOVEFILE_REPLACE_EXISTING)
+        && MoveFileExA(temp_path, deep->path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return rename(tt_temp_path, tt_path) == 0 && rename(temp_path, deep->path) == 0;
+#endif
+}
+
+// Read a checkpoint written by save_checkpoint()
+int load_checkpoint(const char* path, SearchCheckpoint* checkpoint) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    int ok = fread(checkpoint, sizeof(SearchCheckpoint), 1, file) == 1
+          && memcmp(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0
+          && checkpoint->version == CHECKPOINT_VERSION
+          && checkpoint->root_count >= 0 && checkpoint->root_count <= MAX_MOVES
+          && checkpoint->pv_length >= 0 && checkpoint->pv_length <= MAX_PLY
+          && (checkpoint->tt_slot == 0 || checkpoint->tt_slot == 1);
+    fclose(file);
+    return ok;
+}
+
+// Iteration hook: report the iteration and checkpoint when the interval
+// has passed and the search has run at least CHECKPOINT_COST_RATIO times
+// as long as the last checkpoint took, keeping the overhead near 2%
+void deep_search_hook(void* context, int depth, int score) {
+    DeepSearch* deep = (DeepSearch*)context;
+    long long now = get_time_ms();
+    long long wait = deep->last_cost * CHECKPOINT_COST_RATIO;
+    char from_str[3], to_str[3];
+
+    position_to_algebraic(deep->state->best_from, from_str);
+    position_to_algebraic(deep->state->best_to, to_str);
+    printf("depth %d score %d nodes %llu time %lld best %s%s\n", depth, score,
+           deep->previous_nodes + total_nodes(deep->state),
+           deep->previous_elapsed + now - deep->start, from_str, to_str);
+    fflush(stdout);
+    deep->completed_depth = depth;
+    deep->completed_score = score;
+
+    if (now - deep->last_checkpoint < (wait > deep->state->checkpoint_ms ? wait : deep->state->checkpoint_ms)) {
+        return;
+    }
+    if (!save_checkpoint(deep, depth, score)) {
+        printf("Checkpoint to %s failed\n", deep->path);
+    }
+    deep->last_checkpoint = get_time_ms();
+    deep->last_cost = deep->last_checkpoint - now;
+    deep->total_cost += deep->last_cost;
+    deep->checkpoints++;
+    deep->saved_depth = depth;
+}
+
+// Deep search of one position with periodic checkpoints. If the checkpoint
+// file already holds the same position (or no FEN is given), the search
+// resumes after its last completed iteration with the saved hash table,
+// root move order and totals.
+void run_deep_search(ChessState* state, const char* path, int depth, const char* fen) {
+    static SearchCheckpoint checkpoint;
+    static DeepSearch deep;
+    char tt_path[300];
+
+    memset(&deep, 0, sizeof(deep));
+    deep.state = state;
+    deep.path = path;
+    if (depth <= 0) {
+        depth = ANALYSIS_MAX_DEPTH;
+    }
+
+    deep.color = WHITE;
+    if (fen) {
+        deep.color = load_fen(state, fen);
+        if (deep.color < 0) {
+            printf("Bad FEN\n");
+            return;
+        }
+    } else {
+        init_chess(state);
+    }
+
+    clear_search_tables(state);
+    tt_clear();
+    state->start_depth = 0;
+
+    if (load_checkpoint(path, &checkpoint)
+        && (!fen || (memcmp(checkpoint.board, state->board, BOARD_SIZE) == 0 && checkpoint.color == deep.color))) {
+        memcpy(state->board, checkpoint.board, BOARD_SIZE);
+        state->enp = checkpoint.enp;
+        deep.color = checkpoint.color;
+        state->root_count = checkpoint.root_count;
+        memcpy(state->root_moves, checkpoint.root_moves, sizeof(state->root_moves));
+        state->start_depth = checkpoint.completed_depth + 1;
+        deep.previous_nodes = checkpoint.nodes;
+        deep.previous_elapsed = checkpoint.elapsed_ms;
+        deep.tt_slot = checkpoint.tt_slot;
+        snprintf(tt_path, sizeof(tt_path), "%s.tt%d", path, checkpoint.tt_slot);
+        if (!tt_load(tt_path, state->tt_mmap)) {
+            printf("Hash table snapshot %s missing, resuming with an empty table\n", tt_path);
+        }
+        printf("Resuming after depth %d (score %d, %lld ms, %llu nodes so far)\n",
+               checkpoint.completed_depth, checkpoint.score, checkpoint.elapsed_ms, checkpoint.nodes);
+    }
+
+    state->iteration_hook = deep_search_hook;
+    state->hook_context = &deep;
+    state->nodes = 0;
+    state->stop = 0;
+    deep.start = deep.last_checkpoint = get_time_ms();
+
+    if (state->start_depth <= depth) {
+        parallel_search(state, deep.color, depth * 2);
+    }
+
+    // Always keep the deepest finished iteration so the search can be extended
+    if (deep.completed_depth > deep.saved_depth) {
+        long long before = get_time_ms();
+        save_checkpoint(&deep, deep.completed_depth, deep.completed_score);
+        deep.total_cost += get_time_ms() - before;
+        deep.checkpoints++;
+    }
+
+    long long elapsed = get_time_ms() - deep.start;
+    state->iteration_hook = NULL;
+    state->start_depth = 0;
+
+    printf("Checkpoints: %d, %lld ms of %lld ms (%.2f%%)\n", deep.checkpoints, deep.total_cost, elapsed,
+           elapsed > 0 ? 100.0 * (double)deep.total_cost / (double)elapsed : 0.0);
+}
+
+// Distance of a square from the edge (0 on the rim, 6 in the centre)
+int record_centrality(int sq) {
+    int file = sq & 7;
+    int rank = sq >> 4;
+    return (file < 7 - file ? file : 7 - file) + (rank < 7 - rank ? rank : 7 - rank);
+}
+
+// Pseudo-legal moves in a fixed order that depends only on the position:
+// captures by MVV/LVA, then promotions, then quiet moves by centralization.
+// Ties keep generation order, so encoder and decoder always agree.
+int record_move_list(const ChessState* state, int color, Move* moves) {
+    int count = generate_moves(state, color, moves);
+
+    for (int i = 0; i < count; i++) {
+        unsigned char piece = state->board[moves[i].from];
+        unsigned char victim = state->board[moves[i].to];
+        int to = moves[i].to;
+
+        if (victim != EMPTY) {
+            moves[i].score = 1000 + piece_scores[get_piece_type(victim)] * 16 - piece_scores[get_piece_type(piece)];
+        } else if (get_piece_type(piece) == PAWN && ((to & 0xF0) == 0x00 || (to & 0xF0) == 0x70)) {
+            moves[i].score = 900;
+        } else {
+            moves[i].score = 100 + record_centrality(to) - record_centrality(moves[i].from);
+        }
+    }
+
+    // Stable insertion sort, best first
+    for (int i = 1; i < count; i++) {
+        Move move = moves[i];
+        int j = i;
+        while (j > 0 && moves[j - 1].score < move.score) {
+            moves[j] = moves[j - 1];
+            j--;
+        }
+        moves[j] = move;
+    }
+    return count;
+}
+
+void range_encoder_init(RangeEncoder* encoder, unsigned char* out, int capacity) {
+    encoder->out = out;
+    encoder->size = 0;
+    encoder->capacity = capacity;
+    encoder->overflow = 0;
+    encoder->low = 0;
+    encoder->range = 0xFFFFFFFFu;
+    encoder->cache = 0;
+    encoder->cache_size = 1;
+}
+
+void range_put_byte(RangeEncoder* encoder, unsigned char byte) {
+    if (encoder->size < encoder->capacity) {
+        encoder->out[encoder->size++] = byte;
+    } else {
+        encoder->overflow = 1;
+    }
+}
+
+void range_shift_low(RangeEncoder* encoder) {
+    if ((unsigned int)encoder->low < 0xFF000000u || (encoder->low >> 32) != 0) {
+        unsigned char carry = (unsigned char)(encoder->low >> 32);
+        unsigned char byte = encoder->cache;
+        do {
+            range_put_byte(encoder, (unsigned char)(byte + carry));
+            byte = 0xFF;
+        } while (--encoder->cache_size != 0);
+        encoder->cache = (unsigned char)(encoder->low >> 24);
+    }
+    encoder->cache_size++;
+    encoder->low = (encoder->low & 0x00FFFFFFu) << 8;
+}
+
+void range_encode_bit(RangeEncoder* encoder, unsigned short* prob, int bit) {
+    unsigned int bound = (encoder->range >> RECORD_PROB_BITS) * *prob;
+
+    if (bit) {
+        encoder->low += bound;
+        encoder->range -= bound;
+        *prob -= *prob >> RECORD_ADAPT_SHIFT;
+    } else {
+        encoder->range = bound;
+        *prob += ((1 << RECORD_PROB_BITS) - *prob) >> RECORD_ADAPT_SHIFT;
+    }
+    while (encoder->range < RECORD_TOP) {
+        encoder->range <<= 8;
+        range_shift_low(encoder);
+    }
+}
+
+// Flush, then drop the leading byte (always zero) and trailing zeros, which
+// the decoder supplies itself. Returns the payload size, -1 on overflow.
+int range_encoder_finish(RangeEncoder* encoder) {
+    for (int i = 0; i < 5; i++) {
+        range_shift_low(encoder);
+    }
+    if (encoder->overflow) {
+        return -1;
+    }
+    int size = encoder->size;
+    while (size > 0 && encoder->out[size - 1] == 0) {
+        size--;
+    }
+    if (size > 0) {
+        memmove(encoder->out, encoder->out + 1, (size_t)--size);
+    }
+    return size;
+}
+
+unsigned char range_next_byte(RangeDecoder* decoder) {
+    return decoder->pos < decoder->size ? decoder->in[decoder->pos++] : 0;
+}
+
+void range_decoder_init(RangeDecoder* decoder, const unsigned char* in, int size) {
+    decoder->in = in;
+    decoder->pos = 0;
+    decoder->size = size;
+    decoder->range = 0xFFFFFFFFu;
+    decoder->code = 0;
+    for (int i = 0; i < 4; i++) {
+        decoder->code = (decoder->code << 8) | range_next_byte(decoder);
+    }
+}
+
+int range_decode_bit(RangeDecoder* decoder, unsigned short* prob) {
+    unsigned int bound = (decoder->range >> RECORD_PROB_BITS) * *prob;
+    int bit;
+
+    if (decoder->code < bound) {
+        decoder->range = bound;
+        *prob += ((1 << RECORD_PROB_BITS) - *prob) >> RECORD_ADAPT_SHIFT;
+        bit = 0;
+    } else {
+        decoder->code -= bound;
+        decoder->range -= bound;
+        *prob -= *prob >> RECORD_ADAPT_SHIFT;
+        bit = 1;
+    }
+    while (decoder->range < RECORD_TOP) {
+        decoder->range <<= 8;
+        decoder->code = (decoder->code << 8) | range_next_byte(decoder);
+    }
+    return bit;
+}
+
+void record_model_init(RecordModel* model) {
+    unsigned short* probs = &model->prefix[0][0];
+    int total = (int)(sizeof(RecordModel) / sizeof(unsigned short));
+
+    for (int i = 0; i < total; i++) {
+        probs[i] = 1 << (RECORD_PROB_BITS - 1);
+    }
+}
+
+// Model context: how many moves there are and whether the last move captured
+int record_context(int count, int previous_capture) {
+    int bucket = count <= 20 ? 0 : count <= 30 ? 1 : count <= 40 ? 2 : 3;
+    return bucket * 2 + previous_capture;
+}
+
+// Elias-gamma class of a value >= 1 (floor of log2)
+int record_class(int value) {
+    int bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+// Rank 0..count (count = escape) as rank + 1: the class in unary, capped
+// at the largest class possible for this move list, then the lower bits
+void encode_rank(RangeEncoder* encoder, RecordModel* model, int context, int rank, int count) {
+    int value = rank + 1;
+    int value_class = record_class(value);
+    int max_class = record_class(count + 1);
+
+    for (int i = 0; i < max_class; i++) {
+        int more = i < value_class;
+        range_encode_bit(encoder, &model->prefix[context][i], more);
+        if (!more) {
+            break;
+        }
+    }
+    for (int bit = value_class - 1; bit >= 0; bit--) {
+        range_encode_bit(encoder, &model->suffix[value_class][bit], (value >> bit) & 1);
+    }
+}
+
+int decode_rank(RangeDecoder* decoder, RecordModel* model, int context, int count) {
+    int max_class = record_class(count + 1);
+    int value_class = 0;
+
+    while (value_class < max_class && range_decode_bit(decoder, &model->prefix[context][value_class])) {
+        value_class++;
+    }
+    int value = 1;
+    for (int bit = value_class - 1; bit >= 0; bit--) {
+        value = (value << 1) | range_decode_bit(decoder, &model->suffix[value_class][bit]);
+    }
+    return value - 1;
+}
+
+// Squares of moves outside the list, 7 bits each with a fixed 50% model
+void encode_square(RangeEncoder* encoder, int square) {
+    for (int bit = 6; bit >= 0; bit--) {
+        unsigned short prob = 1 << (RECORD_PROB_BITS - 1);
+        range_encode_bit(encoder, &prob, (square >> bit) & 1);
+    }
+}
+
+int decode_square(RangeDecoder* decoder) {
+    int square = 0;
+    for (int bit = 6; bit >= 0; bit--) {
+        unsigned short prob = 1 << (RECORD_PROB_BITS - 1);
+        square = (square << 1) | range_decode_bit(decoder, &prob);
+    }
+    return square;
+}
+
+// Encode one game: varint ply count, FEN length and text (0 = initial
+// position), then the range coded move ranks. Returns bytes written, or
+// -1 if the game does not fit in capacity.
+int encode_game(ChessState* state, const AnnotatedGame* game, unsigned char* out, int capacity) {
+    static RecordModel model;
+    RangeEncoder encoder;
+    Move moves[MAX_MOVES];
+    int fen_length = (int)strlen(game->fen);
+    int size = 0;
+
+    if (capacity < 3 + fen_length) {
+        return -1;
+    }
+    int plies = game->move_count;
+    do {
+        out[size++] = (unsigned char)((plies & 0x7F) | (plies > 0x7F ? 0x80 : 0));
+        plies >>= 7;
+    } while (plies > 0);
+    out[size++] = (unsigned char)fen_length;
+    memcpy(out + size, game->fen, (size_t)fen_length);
+    size += fen_length;
+
+    int color = setup_game_position(state, game, 0);
+    int previous_capture = 0;
+    record_model_init(&model);
+    range_encoder_init(&encoder, out + size, capacity - size);
+
+    for (int ply = 0; ply < game->move_count; ply++) {
+        int from = game->from[ply];
+        int to = game->to[ply];
+        int count = record_move_list(state, color, moves);
+        int rank = 0;
+
+        while (rank < count && (moves[rank].from != from || moves[rank].to != to)) {
+            rank++;
+        }
+        encode_rank(&encoder, &model, record_context(count, previous_capture), rank, count);
+        if (rank == count) {
+            encode_square(&encoder, from);
+            encode_square(&encoder, to);
+        }
+
+        previous_capture = state->board[to] != EMPTY;
+        make_move(state, from, to);
+        color ^= COLOR_MASK;
+    }
+
+    int payload = range_encoder_finish(&encoder);
+    return payload < 0 ? -1 : size + payload;
+}
+
+// Decode a game written by encode_game(), replaying it with make_move()
+// (the board is left at the final position). Returns 1 on success.
+int decode_game(ChessState* state, const unsigned char* data, int size, AnnotatedGame* game) {
+    static RecordModel model;
+    RangeDecoder decoder;
+    Move moves[MAX_MOVES];
+    int pos = 0;
+    int plies = 0;
+    int shift = 0;
+
+    do {
+        if (pos >= size || shift > 14) {
+            return 0;
+        }
+        plies |= (data[pos] & 0x7F) << shift;
+        shift += 7;
+    } while (data[pos++] & 0x80);
+    if (pos >= size || plies > MAX_GAME_MOVES) {
+        return 0;
+    }
+    int fen_length = data[pos++];
+    if (fen_length >= (int)sizeof(game->fen) || pos + fen_length > size) {
+        return 0;
+    }
+    memcpy(game->fen, data + pos, (size_t)fen_length);
+    game->fen[fen_length] = '\0';
+    pos += fen_length;
+    game->move_count = plies;
+
+    int color = setup_game_position(state, game, 0);
+    int previous_capture = 0;
+    record_model_init(&model);
+    range_decoder_init(&decoder, data + pos, size - pos);
+
+    for (int ply = 0; ply < plies; ply++) {
+        int count = record_move_list(state, color, moves);
+        int rank = decode_rank(&decoder, &model, record_context(count, previous_capture), count);
+        int from, to;
+
+        if (rank < count) {
+            from = moves[rank].from;
+            to = moves[rank].to;
+        } else {
+            from = decode_square(&decoder);
+            to = decode_square(&decoder);
+            if ((from & 0x88) || (to & 0x88)) {
+                return 0;
+            }
+        }
+        game->from[ply] = (unsigned char)from;
+        game->to[ply] = (unsigned char)to;
+
+        previous_capture = state->board[to] != EMPTY;
+        make_move(state, from, to);
+        color ^= COLOR_MASK;
+    }
+    return 1;
+}
+
+// Shallow self-play game with some random moves for variety. Ends before
+// a king capture, when a side has no moves, or after max_plies.
+int self_play_game(ChessState* state, AnnotatedGame* game, int max_plies) {
+    Move moves[MAX_MOVES];
+    int color = WHITE;
+
+    memset(game, 0, sizeof(AnnotatedGame));
+    init_chess(state);
+    while (game->move_count < max_plies && game->move_count < MAX_GAME_MOVES) {
+        int count = generate_moves(state, color, moves);
+        int from, to;
+
+        if (count == 0) {
+            break;
+        }
+        if ((get_random_byte(state) & 15) == 0) {
+            int pick = (get_random_byte(state) * count) >> 8;
+            from = moves[pick].from;
+            to = moves[pick].to;
+        } else {
+            state->stop = 0;
+            search_position(state, color, 4);
+            from = state->best_from;
+            to = state->best_to;
+            if (from < 0 || to < 0) {
+                break;
+            }
+        }
+        if (get_piece_type(state->board[to]) == KING) {
+            break;
+        }
+        game->from[game->move_count] = (unsigned char)from;
+        game->to[game->move_count] = (unsigned char)to;
+        game->move_count++;
+        make_move(state, from, to);
+        color ^= COLOR_MASK;
+    }
+    return game->move_count;
+}
+
+// Encode an archive (self-play games, a PGN file or a saved archive),
+// check that every game decodes back, and report size and decode speed.
+// Archive files are RECORD_MAGIC, a 32-bit game count, then each game as
+// a varint length followed by its encoded bytes.
+void run_records(ChessState* state, const char* source, const char* output) {
+    AnnotatedGame* games = NULL;
+    static AnnotatedGame decoded;
+    unsigned char* archive = NULL;
+    long long archive_size = 0;
+    int game_count = 0;
+    char magic[8];
+
+    if (source == NULL || isdigit((unsigned char)source[0])) {
+        game_count = source ? atoi(source) : RECORD_GAMES;
+        games = (AnnotatedGame*)malloc((size_t)(game_count > 0 ? game_count : 1) * sizeof(AnnotatedGame));
+        if (!games) {
+            printf("Out of memory\n");
+            return;
+        }
+        state->rand_seed = 1;  // Same archive on every run
+        long long start = get_time_ms();
+        for (int i = 0; i < game_count; i++) {
+            self_play_game(state, &games[i], RECORD_MAX_PLIES);
+        }
+        printf("Generated %d self-play games in %lld ms\n", game_count, get_time_ms() - start);
+    } else {
+        FILE* file = fopen(source, "rb");
+        if (!file) {
+            printf("Cannot open %s\n", source);
+            return;
+        }
+        if (fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+            && memcmp(magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) == 0) {
+            // Saved archive: decode it to get the games back
+            unsigned char count_bytes[4];
+            int ok = fread(count_bytes, 1, 4, file) == 4;
+            game_count = ok ? count_bytes[0] | count_bytes[1] << 8 | count_bytes[2] << 16 | count_bytes[3] << 24 : 0;
+            games = (AnnotatedGame*)malloc((size_t)(game_count > 0 ? game_count : 1) * sizeof(AnnotatedGame));
+            static unsigned char record[RECORD_MAX_BYTES];
+            for (int i = 0; ok && games && i < game_count; i++) {
+                int length = 0, shift = 0, c;
+                do {
+                    c = fgetc(file);
+                    length |= (c & 0x7F) << shift;
+                    shift += 7;
+                } while (c != EOF && (c & 0x80) && shift < 21);
+                ok = c != EOF && length <= RECORD_MAX_BYTES
+                  && fread(record, 1, (size_t)length, file) == (size_t)length
+                  && decode_game(state, record, length, &games[i]);
+            }
+            fclose(file);
+            if (!games || !ok) {
+                printf("Bad game archive %s\n", source);
+                free(games);
+                return;
+            }
+        } else {
+            fclose(file);
+            game_count = read_pgn_games(state, source, &games);
+        }
+    }
+
+    // Encode everything into one buffer of length-prefixed records
+    archive = (unsigned char*)malloc((size_t)game_count * (RECORD_MAX_BYTES + 3) + 1);
+    if (!archive) {
+        printf("Out of memory\n");
+        free(games);
+        return;
+    }
+    long long total_moves = 0;
+    int failed = 0;
+    long long start = get_time_ms();
+    for (int i = 0; i < game_count; i++) {
+        static unsigned char record[RECORD_MAX_BYTES];
+        int length = encode_game(state, &games[i], record, RECORD_MAX_BYTES);
+        if (length < 0) {
+            failed++;
+            length = 0;  // Stored as an empty record
+        }
+        int value = length;
+        do {
+            archive[archive_size++] = (unsigned char)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+            value >>= 7;
+        } while (value > 0);
+        memcpy(archive + archive_size, record, (size_t)length);
+        archive_size += length;
+        total_moves += games[i].move_count;
+    }
+    long long encode_time = get_time_ms() - start;
+
+    // Decode the whole archive repeatedly for a stable rate, checking the first pass
+    int mismatches = 0;
+    long long passes = 0;
+    long long decode_time;
+    start = get_time_ms();
+    do {
+        long long pos = 0;
+        for (int i = 0; i < game_count; i++) {
+            int length = 0, shift = 0;
+            do {
+                length |= (archive[pos] & 0x7F) << shift;
+                shift += 7;
+            } while (archive[pos++] & 0x80);
+            int ok = length > 0 && decode_game(state, archive + pos, length, &decoded);
+            if (passes == 0 && length > 0
+                && (!ok || decoded.move_count != games[i].move_count || strcmp(decoded.fen, games[i].fen) != 0
+                    || memcmp(decoded.from, games[i].from, (size_t)games[i].move_count) != 0
+                    || memcmp(decoded.to, games[i].to, (size_t)games[i].move_count) != 0)) {
+                mismatches++;
+            }
+            pos += length;
+        }
+        passes++;
+        decode_time = get_time_ms() - start;
+    } while (decode_time < RECORD_DECODE_MS);
+
+    printf("Games           : %d (%lld plies)\n", game_count, total_moves);
+    printf("Text bytes      : %lld (5 per move as printed by the engine)\n", total_moves * 5);
+    printf("Encoded bytes   : %lld (%.1f per game, %.2f bits per move)\n", archive_size,
+           game_count ? (double)archive_size / game_count : 0.0,
+           total_moves ? 8.0 * (double)archive_size / (double)total_moves : 0.0);
+    printf("Encode time (ms): %lld\n", encode_time);
+    printf("Decode          : %.0f games/s (%lld passes in %lld ms)\n",
+           decode_time > 0 ? 1000.0 * (double)game_count * (double)passes / (double)decode_time : 0.0,
+           passes, decode_time);
+    printf("Round trip      : %s (%d mismatches, %d too long)\n",
+           mismatches == 0 && failed == 0 ? "ok" : "FAILED", mismatches, failed);
+
+    if (output) {
+        FILE* file = fopen(output, "wb");
+        unsigned char header[12] = {0};
+        memcpy(header, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+        header[8] = (unsigned char)game_count;
+        header[9] = (unsigned char)(game_count >> 8);
+        header[10] = (unsigned char)(game_count >> 16);
+        header[11] = (unsigned char)(game_count >> 24);
+        int ok = file && fwrite(header, 1, sizeof(header), file) == sizeof(header)
+              && fwrite(archive, 1, (size_t)archive_size, file) == (size_t)archive_size;
+        if (file && fclose(file) != 0) {
+            ok = 0;
+        }
+        printf("%s %s\n", ok ? "Archive written to" : "Cannot write", output);
+    }
+
+    free(archive);
+    free(games);
+}
+
+// One turn of run_game() without the console: validate and play the
+// player's (white) move, then let the engine answer at depth_limit.
+// Appends both moves to the transcript ("?" marks a rejected move).
+// Returns 0 if the move was illegal, -1 if the engine had no reply.
+int replay_player_move(ChessState* state, int from, int to, int depth_limit, char* transcript, int* length) {
+    char from_str[3], to_str[3];
+
+    position_to_algebraic(from, from_str);
+    position_to_algebraic(to, to_str);
+    if (!move_is_legal(state, from, to, WHITE)) {
+        *length += snprintf(transcript + *length, (size_t)(REPLAY_TRANSCRIPT - *length), "%s%s? ", from_str, to_str);
+        return 0;
+    }
+    if (async_log) {
+        log_push(state->thread_id, LOG_MOVE, WHITE, 0, 0, from, to, 0);
+    }
+    make_move(state, from, to);
+    *length += snprintf(transcript + *length, (size_t)(REPLAY_TRANSCRIPT - *length), "%s%s ", from_str, to_str);
+
+    int move = engine_move(state, BLACK, depth_limit);
+    if (move < 0) {
+        *length += snprintf(transcript + *length, (size_t)(REPLAY_TRANSCRIPT - *length), "# ");
+        return -1;
+    }
+    position_to_algebraic(move & 0xFF, from_str);
+    position_to_algebraic(move >> 8, to_str);
+    *length += snprintf(transcript + *length, (size_t)(REPLAY_TRANSCRIPT - *length), "%s%s ", from_str, to_str);
+    return 1;
+}
+
+// Print one finished game of the replay
+void replay_end_game(int game, int plies, char* transcript, int length, long long elapsed) {
+    if (length > 0 && transcript[length - 1] == ' ') {
+        transcript[--length] = '\0';
+    }
+    printf("%d: %s (%d plies, %lld ms)\n", game, transcript, plies, elapsed);
+}
+
+// Play scripted games at full speed. The script (a file, or stdin for
+// "-") lists the player's moves in coordinate notation; a blank line or
+// "new" starts the next game, '#' starts a comment. Each game starts from
+// the initial position with cleared tables, so runs are repeatable. The
+// board is never displayed; one transcript line is printed per game.
+void run_replay(ChessState* state, const char* path, int depth) {
+    static char line[REPLAY_LINE];
+    static char transcript[REPLAY_TRANSCRIPT];
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    int depth_limit = depth > 0 ? depth * 2 : MAX_DEPTH_PLY0;
+    int games = 0;
+    int game_plies = 0;
+    int length = 0;
+    int in_game = 0;
+    int finished = 0;                           // Engine had no reply: skip the rest
+    long long total_plies = 0;
+    long long game_start = 0;
+
+    if (!file) {
+        printf("Cannot open %s\n", path);
+        return;
+    }
+
+    long long start = get_time_ms();
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        int blank = 1;
+        for (char* token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+            int from, to;
+            blank = 0;
+
+            if (strcmp(token, "new") == 0) {
+                if (in_game) {
+                    replay_end_game(++games, game_plies, transcript, length, get_time_ms() - game_start);
+                    total_plies += game_plies;
+                    in_game = 0;
+                }
+                continue;
+            }
+            if (!parse_coordinate_move(token, &from, &to)) {
+                continue;  // Move numbers and results
+            }
+            if (!in_game) {
+                init_chess(state);
+                clear_search_tables(state);
+                tt_clear();
+                in_game = 1;
+                finished = 0;
+                game_plies = 0;
+                length = 0;
+                transcript[0] = '\0';
+                game_start = get_time_ms();
+                if (async_log) {
+                    log_push_game(state->thread_id, games + 1);
+                }
+                log_poll();
+            }
+            if (finished || length > REPLAY_TRANSCRIPT - 16) {
+                continue;
+            }
+            int result = replay_player_move(state, from, to, depth_limit, transcript, &length);
+            game_plies += result > 0 ? 2 : result < 0 ? 1 : 0;
+            finished = result < 0;
+        }
+
+        if (blank && in_game) {
+            replay_end_game(++games, game_plies, transcript, length, get_time_ms() - game_start);
+            total_plies += game_plies;
+            in_game = 0;
+        }
+    }
+    if (in_game) {
+        replay_end_game(++games, game_plies, transcript, length, get_time_ms() - game_start);
+        total_plies += game_plies;
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    long long elapsed = get_time_ms() - start;
+    printf("Games: %d, plies: %lld, wall time %lld ms (%.2f ms per game)\n", games, total_plies, elapsed,
+           games ? (double)elapsed / games : 0.0);
+}
+
+// Open the log file and start the writer thread. Builds without threads
+// keep the rings and drain them at log_poll() points between moves.
+int log_open(const char* path) {
+    AsyncLog* log = (AsyncLog*)calloc(1, sizeof(AsyncLog));
+    if (!log) {
+        return 0;
+    }
+    log->file = fopen(path, "w");
+    if (!log->file) {
+        free(log);
+        return 0;
+    }
+    log->start = get_time_ms();
+    async_log = log;
+#if !defined(UNIVAC) || defined(POSIX)
+    log->threaded = thread_start(&log->writer, log_writer, log);
+#endif
+    return 1;
+}
+
+// Called from search and game threads: never blocks and never does I/O.
+// Returns the next free record with its common fields set, or NULL when
+// the ring is full (the record is dropped and counted).
+LogRecord* log_reserve(int thread, int type) {
+    AsyncLog* log = async_log;
+    LogRing* ring = &log->rings[thread % MAX_THREADS];
+    unsigned int head = ring->head;
+
+    if (head - ring->tail >= LOG_RING_SIZE) {
+        ring->dropped++;
+        return NULL;
+    }
+    LogRecord* record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    memset(record, 0, sizeof(LogRecord));
+    record->type = (unsigned char)type;
+    record->thread = (unsigned char)thread;
+    record->time_ms = get_time_ms() - log->start;
+    return record;
+}
+
+// Hand the record filled after log_reserve() to the writer
+void log_publish(int thread) {
+    LogRing* ring = &async_log->rings[thread % MAX_THREADS];
+    MEMORY_BARRIER();   // Publish the record before the new head
+    ring->head = ring->head + 1;
+}
+
+// Iteration (color unused) or move record
+void log_push(int thread, int type, int color, int depth, int score, int from, int to, unsigned long long nodes) {
+    LogRecord* record = log_reserve(thread, type);
+    if (!record) {
+        return;
+    }
+    record->from = (unsigned char)(from < 0 ? 0 : from);
+    record->to = (unsigned char)(to < 0 ? 0 : to);
+    record->depth = (short)depth;
+    record->color = (short)color;
+    record->score = score;
+    record->nodes = nodes;
+    log_publish(thread);
+}
+
+void log_push_game(int thread, int game) {
+    LogRecord* record = log_reserve(thread, LOG_GAME_START);
+    if (!record) {
+        return;
+    }
+    record->game = game;
+    log_publish(thread);
+}
+
+// Effort controller metrics record
+void log_push_effort(int thread, int effort, int decision, int ready, int late, unsigned long long budget) {
+    LogRecord* record = log_reserve(thread, LOG_EFFORT);
+    if (!record) {
+        return;
+    }
+    record->effort = effort;
+    record->decision = decision;
+    record->ready = ready;
+    record->late = late;
+    record->budget = budget;
+    log_publish(thread);
+}
+
+// Write the formatted batch to the file
+void log_flush_batch(AsyncLog* log) {
+    if (log->batch_size > 0) {
+        fwrite(log->batch, 1, (size_t)log->batch_size, log->file);
+        log->batch_size = 0;
+    }
+}
+
+// Format every queued record into the batch buffer, writing it out in
+// large blocks; returns the number of records consumed
+int log_drain(void) {
+    AsyncLog* log = async_log;
+    int consumed = 0;
+
+    for (int t = 0; t < MAX_THREADS; t++) {
+        LogRing* ring = &log->rings[t];
+        unsigned int head = ring->head;
+        MEMORY_BARRIER();   // Read records only after seeing the head
+
+        while (ring->tail != head) {
+            const LogRecord* record = &ring->records[ring->tail & (LOG_RING_SIZE - 1)];
+            char* line = log->batch + log->batch_size;
+            char from_str[3], to_str[3];
+
+            if (log->batch_size > LOG_BATCH_BYTES - LOG_LINE) {
+                log_flush_batch(log);
+                line = log->batch;
+            }
+            position_to_algebraic(record->from, from_str);
+            position_to_algebraic(record->to, to_str);
+            if (record->type == LOG_ITERATION) {
+                log->batch_size += snprintf(line, LOG_LINE, "%lld thread %d depth %d score %d nodes %llu best %s%s\n",
+                                            record->time_ms, record->thread, record->depth, record->score,
+                                            record->nodes, from_str, to_str);
+            } else if (record->type == LOG_MOVE) {
+                log->batch_size += snprintf(line, LOG_LINE, "%lld move %s %s%s nodes %llu\n", record->time_ms,
+                                            record->color == WHITE ? "white" : "black", from_str, to_str,
+                                            record->nodes);
+            } else if (record->type == LOG_EFFORT) {
+                static const char* const decisions[] = { "hold", "down", "up" };
+                log->batch_size += snprintf(line, LOG_LINE, "%lld effort %d%% %s budget %llu ready %d late %d%%\n",
+                                            record->time_ms, record->effort, decisions[record->decision % 3],
+                                            record->budget, record->ready, record->late);
+            } else {
+                log->batch_size += snprintf(line, LOG_LINE, "%lld game %d\n", record->time_ms, record->game);
+            }
+            MEMORY_BARRIER();   // Finish reading before releasing the slot
+            ring->tail++;
+            consumed++;
+        }
+
+        unsigned int dropped = ring->dropped;
+        if (dropped != ring->reported) {
+            if (log->batch_size > LOG_BATCH_BYTES - LOG_LINE) {
+                log_flush_batch(log);
+            }
+            log->batch_size += snprintf(log->batch + log->batch_size, LOG_LINE,
+                                        "%lld thread %d dropped %u records\n",
+                                        get_time_ms() - log->start, t, dropped - ring->reported);
+            log->dropped += dropped - ring->reported;
+            ring->reported = dropped;
+        }
+    }
+    log->written += (unsigned long long)consumed;
+    return consumed;
+}
+
+// Writer thread: drain the rings, write when the batch fills or the rings
+// go idle, and sleep while there is nothing to do
+void log_writer(void* arg) {
+    AsyncLog* log = (AsyncLog*)arg;
+
+    while (!log->quit) {
+        if (log_drain() == 0) {
+            log_flush_batch(log);
+            fflush(log->file);
+#ifndef UNIVAC
+            Sleep(1);
+#elif defined(POSIX)
+            usleep(1000);
+#endif
+        }
+    }
+}
+
+// Drain point for builds without a writer thread (between moves)
+void log_poll(void) {
+    if (async_log && !async_log->threaded) {
+        log_drain();
+        log_flush_batch(async_log);
+    }
+}
+
+// Stop the writer, write what is left and report drops
+void log_close(void) {
+    AsyncLog* log = async_log;
+    if (!log) {
+        return;
+    }
+    if (log->threaded) {
+        log->quit = 1;
+        thread_join(log->writer);
+    }
+    log_drain();
+    log_flush_batch(log);
+    fclose(log->file);
+    if (log->dropped > 0) {
+        printf("Log: %llu records written, %llu dropped\n", log->written, log->dropped);
+    }
+    async_log = NULL;
+    free(log);
+}
+
+// Parse a move in SAN (Nf3, exd5, R1a3, e8=Q+, O-O) or coordinate
+// notation against the pseudo-legal moves of the position
+int parse_san_move(const ChessState* state, int color, const char* token, int* from, int* to) {
+    static const char piece_letters[] = " PRBQNK";
+    char san[16];
+    Move moves[MAX_MOVES];
+    int length = 0;
+
+    if (parse_coordinate_move(token, from, to) && state->board[*from] != EMPTY) {
+        return 1;
+    }
+
+    // Keep piece letters, files, ranks and castling marks only
+    for (const char* c = token; *c && length < (int)sizeof(san) - 1; c++) {
+        if (*c == '=') {
+            break;  // The engine always promotes to a queen
+        }
+        if (*c != 'x' && *c != '+' && *c != '#' && *c != '!' && *c != '?' && *c != '-') {
+            san[length++] = *c;
+        }
+    }
+    san[length] = '\0';
+
+    int piece = PAWN;
+    int target;
+    int from_file = -1;
+    int from_rank = -1;
+    int king_row = color == WHITE ? 0x70 : 0x00;
+
+    if (strcmp(san, "OO") == 0 || strcmp(san, "00") == 0) {
+        piece = KING;
+        target = king_row + 6;
+    } else if (strcmp(san, "OOO") == 0 || strcmp(san, "000") == 0) {
+        piece = KING;
+        target = king_row + 2;
+    } else {
+        const char* p = length > 0 ? strchr(piece_letters, san[0]) : NULL;
+        int start = 0;
+        if (p && *p != ' ' && *p != 'P') {
+            piece = (int)(p - piece_letters);
+            start = 1;
+        }
+        if (length - start < 2 || san[length - 2] < 'a' || san[length - 2] > 'h'
+            || san[length - 1] < '1' || san[length - 1] > '8') {
+            return 0;
+        }
+        target = ('8' - san[length - 1]) * 16 + (san[length - 2] - 'a');
+        for (int i = start; i < length - 2; i++) {
+            if (san[i] >= 'a' && san[i] <= 'h') {
+                from_file = san[i] - 'a';
+            } else if (san[i] >= '1' && san[i] <= '8') {
+                from_rank = '8' - san[i];
+            }
+        }
+    }
+
+    int count = generate_moves(state, color, moves);
+    for (int i = 0; i < count; i++) {
+        int origin = moves[i].from;
+        if (moves[i].to == target && get_piece_type(state->board[origin]) == piece
+            && (from_file < 0 || (origin & 7) == from_file) && (from_rank < 0 || (origin >> 4) == from_rank)) {
+            *from = origin;
+            *to = target;
+            return 1;
+        }
+    }
+    // Pawn moves and castling are not always generated by the engine, but
+    // keep the move so suites can still name (or forbid) it
+    if (piece == PAWN) {
+        int back = color == WHITE ? 16 : -16;
+        int origin = from_file >= 0 ? ((target + back) & 0xF0) + from_file : target + back;
+        if (from_file < 0 && state->board[origin] == EMPTY) {
+            origin += back;  // Double push
+        }
+        if (!(origin & 0x88) && origin >= 0 && origin < BOARD_SIZE
+            && (state->board[origin] & PIECE_FULL_MASK) == (PAWN | color)) {
+            *from = origin;
+            *to = target;
+            return 1;
+        }
+        return 0;
+    }
+    if (piece == KING && (state->board[king_row + 4] & PIECE_MASK) == KING
+        && (target == king_row + 6 || target == king_row + 2)) {
+        *from = king_row + 4;
+        *to = target;
+        return 1;
+    }
+    return 0;
+}
+
+// Parse one EPD line: the position fields, "bm"/"am" move lists and "id".
+// Returns 1 if the line has a position and at least one bm or am move.
+int parse_epd(ChessState* state, const char* line, SuitePosition* position) {
+    const char* ops = line;
+
+    memset(position, 0, sizeof(SuitePosition));
+    position->color = load_fen(state, line);
+    if (position->color < 0) {
+        return 0;
+    }
+
+    // Operations start after the four position fields
+    for (int field = 0; field < 4 && *ops; field++) {
+        while (*ops == ' ') ops++;
+        while (*ops && *ops != ' ') ops++;
+    }
+
+    while (*ops) {
+        char op[SUITE_LINE];
+        int length = 0;
+        while (*ops == ' ' || *ops == ';') ops++;
+        while (*ops && *ops != ';' && length < (int)sizeof(op) - 1) {
+            op[length++] = *ops++;
+        }
+        op[length] = '\0';
+
+        if (strncmp(op, "id ", 3) == 0) {
+            const char* text = op + 3;
+            while (*text == ' ' || *text == '"') text++;
+            snprintf(position->id, sizeof(position->id), "%.63s", text);
+            char* quote = strchr(position->id, '"');
+            if (quote) {
+                *quote = '\0';
+            }
+        } else if (strncmp(op, "bm ", 3) == 0 || strncmp(op, "am ", 3) == 0) {
+            int avoid = op[0] == 'a';
+            for (char* token = strtok(op + 3, " "); token; token = strtok(NULL, " ")) {
+                int from, to;
+                int* count = avoid ? &position->avoid_count : &position->best_count;
+                unsigned short* list = avoid ? position->avoid : position->best;
+                if (*count < SUITE_MAX_MOVES && parse_san_move(state, position->color, token, &from, &to)) {
+                    list[(*count)++] = (unsigned short)(from | (to << 8));
+                }
+            }
+        }
+    }
+    return position->best_count > 0 || position->avoid_count > 0;
+}
+
+// Iteration hook: track since when the chosen move has been right, and
+// stop the search once the time or node limit is used up
+void suite_hook(void* context, int depth, int score) {
+    SuitePosition* position = (SuitePosition*)context;
+    ChessState* state = position->state;
+    unsigned short move = (unsigned short)(state->best_from | (state->best_to << 8));
+    int correct = position->best_count == 0;
+    long long elapsed = get_time_ms() - position->start;
+    unsigned long long nodes = total_nodes(state);
+
+    (void)score;
+    for (int i = 0; i < position->best_count; i++) {
+        if (position->best[i] == move) {
+            correct = 1;
+        }
+    }
+    for (int i = 0; i < position->avoid_count; i++) {
+        if (position->avoid[i] == move) {
+            correct = 0;
+        }
+    }
+
+    if (!correct) {
+        position->found_depth = 0;
+    } else if (position->found_depth == 0) {
+        position->found_depth = depth;
+        position->found_time = elapsed;
+        position->found_nodes = nodes;
+    }
+    position->last_from = state->best_from;
+    position->last_to = state->best_to;
+    position->last_depth = depth;
+
+    if (elapsed >= position->time_limit || (position->node_limit && nodes >= position->node_limit)) {
+        state->stop = 1;
+    }
+}
+
+// Yield hook: stop inside an iteration once the time or node limit is
+// reached. The first iteration always completes, so there is a move.
+void suite_yield(void* context) {
+    SuitePosition* position = (SuitePosition*)context;
+    ChessState* state = position->state;
+
+    if (state->root_count > 0 && (get_time_ms() - position->start >= position->time_limit
+                                  || (position->node_limit && total_nodes(state) >= position->node_limit))) {
+        state->stop = 1;
+    }
+    state->yield_nodes = state->nodes + SUITE_CHECK_NODES;
+}
+
+// Run every EPD position with cleared tables under the time (or node)
+// limit on -threads threads. A position counts as solved at the time of
+// the iteration from which the best move was right to the end of the
+// search; the summary gives solve counts at increasing time thresholds.
+void run_suite(ChessState* state, const char* path, int time_ms, unsigned long long node_limit) {
+    static const long long thresholds[] = {10, 100, 250, 500, 1000, 2000, 5000, 10000, 30000, 60000};
+    static SuitePosition position;
+    static long long solve_times[4096];
+    char line[SUITE_LINE];
+    FILE* file = fopen(path, "r");
+    int total = 0;
+    int solved = 0;
+    unsigned long long nodes = 0;
+
+    if (!file) {
+        printf("Cannot open %s\n", path);
+        return;
+    }
+    if (time_ms <= 0) {
+        time_ms = SUITE_TIME_MS;
+    }
+
+    long long start = get_time_ms();
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (!parse_epd(state, line, &position)) {
+            continue;
+        }
+        total++;
+        if (position.id[0] == '\0') {
+            snprintf(position.id, sizeof(position.id), "#%d", total);
+        }
+
+        clear_search_tables(state);
+        tt_clear();
+        position.state = state;
+        position.time_limit = time_ms;
+        position.node_limit = node_limit;
+        state->iteration_hook = suite_hook;
+        state->hook_context = &position;
+        state->yield_hook = suite_yield;
+        state->yield_context = &position;
+        state->nodes = 0;
+        state->yield_nodes = SUITE_CHECK_NODES;
+        state->stop = 0;
+        position.start = get_time_ms();
+        parallel_search(state, position.color, ANALYSIS_MAX_DEPTH * 2);
+        state->iteration_hook = NULL;
+        state->yield_hook = NULL;
+        nodes += total_nodes(state);
+
+        char from_str[3], to_str[3];
+        position_to_algebraic(position.last_from, from_str);
+        position_to_algebraic(position.last_to, to_str);
+        if (position.found_depth > 0) {
+            if (solved < (int)(sizeof(solve_times) / sizeof(solve_times[0]))) {
+                solve_times[solved] = position.found_time;
+            }
+            solved++;
+            printf("%-20s solved   %s%s depth %d time %lld nodes %llu\n", position.id, from_str, to_str,
+                   position.found_depth, position.found_time, position.found_nodes);
+        } else {
+            printf("%-20s unsolved %s%s depth %d\n", position.id, from_str, to_str, position.last_depth);
+        }
+        fflush(stdout);
+    }
+    fclose(file);
+
+    printf("Solved %d of %d in %lld ms (%llu nodes, %d threads, limit %d ms", solved, total,
+           get_time_ms() - start, nodes, helper_count + 1, time_ms);
+    if (node_limit) {
+        printf(" / %llu nodes", node_limit);
+    }
+    printf(")\n");
+    for (int t = 0; t <= (int)(sizeof(thresholds) / sizeof(thresholds[0])); t++) {
+        long long threshold = t < (int)(sizeof(thresholds) / sizeof(thresholds[0])) ? thresholds[t] : time_ms;
+        if (threshold > time_ms || (threshold == time_ms && t < (int)(sizeof(thresholds) / sizeof(thresholds[0])))) {
+            continue;  // The limit itself is printed last
+        }
+        int count = 0;
+        for (int i = 0; i < solved && i < (int)(sizeof(solve_times) / sizeof(solve_times[0])); i++) {
+            if (solve_times[i] <= threshold) {
+                count++;
+            }
+        }
+        printf("  <= %6lld ms: %d\n", threshold, count);
+    }
+}
+
+// Positive root by Newton iterations (no libm needed)
+double spsa_root(double value, int n) {
+    double root = value > 1.0 ? value / n : 1.0;
+    for (int i = 0; i < 64; i++) {
+        double power = 1.0;
+        for (int j = 1; j < n; j++) {
+            power *= root;
+        }
+        root -= (power * root - value) / (n * power);
+    }
+    return root;
+}
+
+// Set every parameter from a value array in table order
+void apply_search_params(ChessState* state, const int* values) {
+    for (int i = 0; i < search_param_count; i++) {
+        *(int*)((char*)state + search_params[i].offset) = values[i];
+    }
+}
+
+// One tuning game: SPSA_OPENING_PLIES random moves from seed, then both
+// sides search to depth with their own parameters (every search takes a
+// new hash salt, which empties the table for it without clearing it, so
+// neither side reuses the other's results and workers can share it). A
+// king capture wins; long games are adjudicated on material. Returns
+// +1 / 0 / -1 for white.
+int spsa_game(ChessState* state, const int* white, const int* black, int depth, unsigned int seed) {
+    Move moves[MAX_MOVES];
+    int color = WHITE;
+
+    init_chess(state);
+    clear_search_tables(state);
+    state->rand_seed = seed;
+
+    for (int ply = 0; ply < SPSA_MAX_PLIES; ply++) {
+        int from, to;
+
+        if (ply < SPSA_OPENING_PLIES) {
+            int count = generate_moves(state, color, moves);
+            if (count == 0) {
+                return 0;
+            }
+            int pick = (get_random_byte(state) * count) >> 8;
+            from = moves[pick].from;
+            to = moves[pick].to;
+        } else {
+            apply_search_params(state, color == WHITE ? white : black);
+            state->hash_salt = next_salt(state->hash_salt);
+            state->stop = 0;
+            iterative_search(state, color, depth * 2);
+            from = state->best_from;
+            to = state->best_to;
+            if (from < 0 || to < 0) {
+                return 0;
+            }
+        }
+        if (get_piece_type(state->board[to]) == KING) {
+            return color == WHITE ? 1 : -1;
+        }
+        make_move(state, from, to);
+        color ^= COLOR_MASK;
+    }
+
+    int material = material_balance(state);
+    return material >= SPSA_ADJUDICATE ? 1 : material <= -SPSA_ADJUDICATE ? -1 : 0;
+}
+
+// White material minus black material, in pawns
+int material_balance(const ChessState* state) {
+    int material = 0;
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        unsigned char piece = state->board[sq];
+        if (!(sq & 0x88) && piece != EMPTY && get_piece_type(piece) != KING) {
+            material += (get_piece_color(piece) == WHITE ? 1 : -1) * piece_scores[get_piece_type(piece)];
+        }
+    }
+    return material;
+}
+
+// Worker thread: play every workers-th pair starting at index
+void spsa_worker(void* arg) {
+    SpsaWorker* worker = (SpsaWorker*)arg;
+
+    worker->result = 0;
+    for (int p = worker->index; p < worker->pairs; p += worker->workers) {
+        unsigned int seed = worker->seed + (unsigned int)p;
+        worker->result += spsa_game(worker->state, worker->plus, worker->minus, worker->depth, seed);
+        worker->result -= spsa_game(worker->state, worker->minus, worker->plus, worker->depth, seed);
+    }
+}
+
+// Play pairs of games (same opening, colors swapped) between the plus and
+// minus parameter sets and return plus wins minus losses. On -DPOSIX
+// builds the pairs are spread over forked workers with private tables,
+// on Windows over threads sharing the hash table.
+int spsa_match(ChessState* state, const int* plus, const int* minus, int pairs, int depth, unsigned int seed,
+               int workers) {
+    int result = 0;
+
+#if defined(UNIVAC) && defined(POSIX)
+    int pipes[2];
+
+    if (workers > 1 && pipe(pipes) == 0) {
+        int started = 0;
+        fflush(stdout);
+        for (int w = 0; w < workers && w < pairs; w++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                int child_result = 0;
+                close(pipes[0]);
+                state->tree_dump = NULL;    // The parent owns the dump
+                for (int p = w; p < pairs; p += workers) {
+                    child_result += spsa_game(state, plus, minus, depth, seed + (unsigned int)p);
+                    child_result -= spsa_game(state, minus, plus, depth, seed + (unsigned int)p);
+                }
+                _exit(write(pipes[1], &child_result, sizeof(child_result)) == sizeof(child_result) ? 0 : 1);
+            }
+            if (pid > 0) {
+                started++;
+            }
+        }
+        close(pipes[1]);
+        for (int w = 0; w < started; w++) {
+            int child_result;
+            if (read(pipes[0], &child_result, sizeof(child_result)) == sizeof(child_result)) {
+                result += child_result;
+            }
+        }
+        close(pipes[0]);
+        while (wait(NULL) > 0) {
+        }
+        return result;
+    }
+#elif !defined(UNIVAC)
+    if (workers > 1) {
+        SpsaWorker spsa_workers[MAX_THREADS];
+        ChessState* states[MAX_THREADS];
+        thread_handle threads[MAX_THREADS];
+        int started = 0;
+
+        if (workers > MAX_THREADS) {
+            workers = MAX_THREADS;
+        }
+        // Worker 0 is this thread; the others get copies with their own
+        // histories and a distinct salt sequence
+        states[0] = state;
+        for (int w = 1; w < workers; w++) {
+            states[w] = (ChessState*)malloc(sizeof(ChessState));
+            if (!states[w]) {
+                workers = w;
+                break;
+            }
+            memcpy(states[w], state, sizeof(ChessState));
+            states[w]->tree_dump = NULL;
+            states[w]->iteration_hook = NULL;
+            states[w]->yield_hook = NULL;
+            states[w]->thread_id = w;
+            states[w]->hash_salt = next_salt(state->hash_salt ^ ((unsigned long long)w << 56));
+            states[w]->cont_hist = NULL;
+            if (state->cont_hist) {
+                init_search_tables(states[w]);  // Plays without it if out of memory
+            }
+        }
+        for (int w = 0; w < workers; w++) {
+            spsa_workers[w].state = states[w];
+            spsa_workers[w].plus = plus;
+            spsa_workers[w].minus = minus;
+            spsa_workers[w].pairs = pairs;
+            spsa_workers[w].depth = depth;
+            spsa_workers[w].seed = seed;
+            spsa_workers[w].index = w;
+            spsa_workers[w].workers = workers;
+        }
+        for (int w = 1; w < workers; w++) {
+            if (thread_start(&threads[started], spsa_worker, &spsa_workers[w])) {
+                started++;
+            } else {
+                spsa_worker(&spsa_workers[w]);  // Play its pairs here instead
+            }
+        }
+        spsa_worker(&spsa_workers[0]);
+        for (int w = 0; w < started; w++) {
+            thread_join(threads[w]);
+        }
+        for (int w = 0; w < workers; w++) {
+            result += spsa_workers[w].result;
+            if (w > 0) {
+                free_search_tables(states[w]);
+                free(states[w]);
+            }
+        }
+        return result;
+    }
+#else
+    (void)workers;
+#endif
+
+    for (int p = 0; p < pairs; p++) {
+        result += spsa_game(state, plus, minus, depth, seed + (unsigned int)p);
+        result -= spsa_game(state, minus, plus, depth, seed + (unsigned int)p);
+    }
+    return result;
+}
+
+// Tuning state as text ("spsa <version>", "iteration <k>", "<name> <value>"),
+// written to a temporary file and renamed so a crash keeps the last one
+int spsa_save(const char* path, int iteration, const double* theta) {
+    char temp_path[300];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE* file = fopen(temp_path, "w");
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "spsa %d\niteration %d\n", SPSA_VERSION, iteration);
+    for (int i = 0; i < search_param_count; i++) {
+        fprintf(file, "%s %.6f\n", search_params[i].name, theta[i]);
+    }
+    if (fclose(file) != 0) {
+        return 0;
+    }
+#ifndef UNIVAC
+    return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return rename(temp_path, path) == 0;
+#endif
+}
+
+// Read a tuning state; parameters missing from the file keep their values
+int spsa_load(const char* path, int* iteration, double* theta) {
+    char name[64];
+    double value;
+    int version = 0;
+    FILE* file = fopen(path, "r");
+
+    if (!file) {
+        return 0;
+    }
+    if (fscanf(file, "spsa %d iteration %d", &version, iteration) != 2 || version != SPSA_VERSION) {
+        fclose(file);
+        return 0;
+    }
+    while (fscanf(file, "%63s %lf", name, &value) == 2) {
+        int index = find_search_param(name);
+        if (index >= 0) {
+            theta[index] = value;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// SPSA over the tunable parameters: each iteration perturbs all of them
+// at once by +/-c_k (random signs), plays a mini-match between the two
+// sets and moves theta towards the winner by a_k * c_k * score. With
+// a_k = 1 / (1 + k / SPSA_STABILITY) and c_k = step / (k + 1)^(1/6) the
+// gains follow the asymptotically optimal exponents (1 and 1/6). The
+// state is saved after every iteration and resumed from the file, so the
+// run can be stopped and restarted at any time; 0 iterations = forever.
+void run_spsa(ChessState* state, const char* path, int iterations, int pairs) {
+    double theta[64];
+    int plus[64], minus[64], delta[64];
+    int workers = 1;
+    int iteration = 0;
+
+    if (pairs <= 0) {
+        pairs = SPSA_PAIRS;
+    }
+    for (int i = 0; i < search_param_count; i++) {
+        theta[i] = get_search_param(state, i);
+    }
+    if (spsa_load(path, &iteration, theta)) {
+        printf("Resuming at iteration %d from %s\n", iteration, path);
+    }
+#if !defined(UNIVAC) || defined(POSIX)
+    workers = state->threads > 1 ? state->threads : cpu_count();
+#endif
+    printf("SPSA: %d pairs per iteration, depth %d, %d workers\n", pairs, SPSA_DEPTH, workers);
+
+    for (int done = 0; iterations <= 0 || done < iterations; done++, iteration++) {
+        double a = 1.0 / (1.0 + (double)iteration / SPSA_STABILITY);
+        double c_scale = 1.0 / spsa_root((double)iteration + 1.0, 6);
+        long long start = get_time_ms();
+
+        state->rand_seed = (unsigned int)iteration * 2654435761u + 1;
+        for (int i = 0; i < search_param_count; i++) {
+            const SearchParam* param = &search_params[i];
+            double c = param->spsa_step * c_scale;
+            delta[i] = (get_random_byte(state) & 0x80) ? 1 : -1;
+            if (param->spsa_step == 0) {
+                plus[i] = minus[i] = (int)(theta[i] + 0.5);
+                continue;
+            }
+            plus[i] = (int)(theta[i] + c * delta[i] + 0.5);     // Ranges are non-negative
+            minus[i] = (int)(theta[i] - c * delta[i] + 0.5);
+            plus[i] = plus[i] < param->min ? param->min : plus[i] > param->max ? param->max : plus[i];
+            minus[i] = minus[i] < param->min ? param->min : minus[i] > param->max ? param->max : minus[i];
+        }
+
+        int result = spsa_match(state, plus, minus, pairs, SPSA_DEPTH, (unsigned int)iteration * 7919u, workers);
+        double score = (double)result / (2.0 * pairs);
+
+        for (int i = 0; i < search_param_count; i++) {
+            const SearchParam* param = &search_params[i];
+            if (param->spsa_step == 0) {
+                continue;
+            }
+            theta[i] += a * param->spsa_step * c_scale * score * delta[i];
+            theta[i] = theta[i] < param->min ? param->min : theta[i] > param->max ? param->max : theta[i];
+        }
+
+        printf("iteration %d score %+.3f time %lld ms:", iteration + 1, score, get_time_ms() - start);
+        for (int i = 0; i < search_param_count; i++) {
+            if (search_params[i].spsa_step) {
+                printf(" %s=%.2f", search_params[i].name, theta[i]);
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (!spsa_save(path, iteration + 1, theta)) {
+            printf("Cannot save SPSA state to %s\n", path);
+        }
+    }
+
+    // The tuned values, ready for -set
+    for (int i = 0; i < search_param_count; i++) {
+        printf("-set %s=%d ", search_params[i].name, (int)(theta[i] + 0.5));
+    }
+    printf("\n");
+}
+
+// Skill levels: depth and node caps, then a move picked at random among
+// the root moves close to the best. Limited levels widen the root window
+// so every move within the margin gets an exact score (MultiPV). The
+// evaluation is material only, so low levels lose detail by seeing each
+// candidate's score with random noise of up to blur pawns.
+const SkillLevel skill_levels[SKILL_LEVELS] = {
+    // plies, nodes, margin, blur
+    {1, 20, 4, 4},
+    {1, 30, 2, 2},
+    {2, 40, 2, 2},
+    {2, 50, 1, 1},
+    {2, 80, 0, 0},
+    {3, 100, 0, 0},
+    {3, 150, 0, 0},
+    {3, 200, 0, 0},
+    {3, 300, 0, 0},
+    {MAX_DEPTH_PLY0 / 2, 0, 0, 0},  // Full strength: the normal search
+};
+
+// Yield hook at the node cap: stop once an iteration has completed, or
+// allow another cap's worth of nodes so there is always a move to play
+void skill_stop(void* context) {
+    ChessState* state = (ChessState*)context;
+    if (state->root_count > 0) {
+        state->stop = 1;
+    } else {
+        state->yield_nodes = state->nodes + (unsigned long long)skill_levels[state->skill - 1].nodes;
+    }
+}
+
+// Search on one thread with the limits of state->skill and leave the
+// chosen move in best_from/best_to; returns its score
+int skill_search(ChessState* state, int color, int depth_limit) {
+    const SkillLevel* level = &skill_levels[state->skill - 1];
+    void (*saved_hook)(void* context) = state->yield_hook;
+    void* saved_context = state->yield_context;
+    unsigned long long saved_yield = state->yield_nodes;
+
+    if (depth_limit > level->plies * 2) {
+        depth_limit = level->plies * 2;
+    }
+    int choose = level->margin > 0 || level->blur > 0;
+    state->root_margin = choose ? level->margin + 1 : 0;
+    if (level->nodes > 0) {
+        state->yield_hook = skill_stop;
+        state->yield_context = state;
+        state->yield_nodes = state->nodes + (unsigned long long)level->nodes;
+    }
+
+    int score = iterative_search(state, color, depth_limit);
+
+    if (level->nodes > 0 && state->nodes >= state->yield_nodes) {
+        state->stop = 0;    // Stopped by the cap, not by the caller
+    }
+    state->yield_hook = saved_hook;
+    state->yield_context = saved_context;
+    state->yield_nodes = saved_yield;
+
+    // Without exact scores (or root list, after a king capture) play the best move
+    state->root_margin = 0;
+    if (!choose || state->root_count == 0 || state->best_from < 0) {
+        return score;
+    }
+
+    // Root moves are sorted by score: the candidates are a prefix
+    int pick = 0;
+    int pick_key = MIN_SCORE * 256;
+    int lowest = state->root_moves[0].score - level->margin;
+    for (int i = 0; i < state->root_count && state->root_moves[i].score >= lowest; i++) {
+        int noise = (get_random_byte(state) * (level->blur + 1)) >> 8;
+        int key = (state->root_moves[i].score + noise) * 256 + get_random_byte(state);
+        if (key > pick_key) {
+            pick = i;
+            pick_key = key;
+        }
+    }
+    state->best_from = state->root_moves[pick].from;
+    state->best_to = state->root_moves[pick].to;
+    return state->root_moves[pick].score;
+}
+
+// One benchmark game between a level and full strength: SKILL_OPENING_PLIES
+// random moves from seed, then each side searches with cleared hash
+// table. The level's moves are counted and timed in stats. Returns
+// +1 / 0 / -1 for the level.
+int skill_game(ChessState* state, int level, int level_color, unsigned int seed, SkillStats* stats) {
+    Move moves[MAX_MOVES];
+    int color = WHITE;
+
+    init_chess(state);
+    clear_search_tables(state);
+    state->rand_seed = seed;
+
+    for (int ply = 0; ply < SKILL_MAX_PLIES; ply++) {
+        int from, to;
+
+        if (ply < SKILL_OPENING_PLIES) {
+            int count = generate_moves(state, color, moves);
+            if (count == 0) {
+                return 0;
+            }
+            int pick = (get_random_byte(state) * count) >> 8;
+            from = moves[pick].from;
+            to = moves[pick].to;
+        } else {
+            tt_clear();
+            state->stop = 0;
+            if (color == level_color) {
+                unsigned long long nodes = state->nodes;
+                long long start = get_time_us();
+                state->skill = level;
+                int score = level < SKILL_LEVELS ? skill_search(state, color, MAX_DEPTH_PLY0)
+                                                 : iterative_search(state, color, MAX_DEPTH_PLY0);
+                stats->us += get_time_us() - start;
+                stats->nodes += state->nodes - nodes;
+                stats->moves++;
+                if (state->root_count > 0 && score < state->root_moves[0].score) {
+                    stats->suboptimal++;
+                }
+            } else {
+                state->skill = SKILL_LEVELS;
+                iterative_search(state, color, MAX_DEPTH_PLY0);
+            }
+            from = state->best_from;
+            to = state->best_to;
+            if (from < 0 || to < 0) {
+                return 0;
+            }
+        }
+        if (get_piece_type(state->board[to]) == KING) {
+            return color == level_color ? 1 : -1;
+        }
+        make_move(state, from, to);
+        color ^= COLOR_MASK;
+    }
+
+    int material = material_balance(state) * (level_color == WHITE ? 1 : -1);
+    return material >= SKILL_ADJUDICATE ? 1 : material <= -SKILL_ADJUDICATE ? -1 : 0;
+}
+
+// Every level plays game pairs (same random opening, colors swapped)
+// against full strength; prints CSV with the level's limits, its nodes
+// and time per move, how often it played a move scored below its
+// search's best and its score
+void run_skill(ChessState* state, int games) {
+    int saved_skill = state->skill;
+
+    if (games <= 0) {
+        games = SKILL_GAMES;
+    }
+    printf("level,plies,node_cap,margin,blur,moves,nodes_per_move,us_per_move,suboptimal_pct,score_pct\n");
+    for (int level = 1; level <= SKILL_LEVELS; level++) {
+        const SkillLevel* limits = &skill_levels[level - 1];
+        SkillStats stats = {0, 0, 0, 0};
+        int points = 0;     // Half points: 2 per win, 1 per draw
+
+        for (int g = 0; g < games; g++) {
+            points += 1 + skill_game(state, level, (g & 1) ? BLACK : WHITE, (unsigned int)(g / 2) * 7919u + 1, &stats);
+        }
+        int moves = stats.moves > 0 ? stats.moves : 1;
+        printf("%d,%d,%d,%d,%d,%d,%llu,%.1f,%.1f,%.1f\n", level, limits->plies, limits->nodes, limits->margin,
+               limits->blur, stats.moves, stats.nodes / (unsigned long long)moves, (double)stats.us / moves,
+               100.0 * stats.suboptimal / moves, 50.0 * points / games);
+        fflush(stdout);
+    }
+    state->skill = saved_skill;
+}
+
+// Hard move deadline. The search reads the clock every deadline-nodes
+// nodes at most (a yield hook, so there is no cost per node); as the
+// deadline nears, reads come every quarter of the remaining time at the
+// measured speed, and the search stops when the next read would fall
+// after the deadline. The move is the best of the deepest completed
+// iteration, or of the aborted one if a root move searched to the end
+// beat it.
+void deadline_start(ChessState* state, SearchDeadline* deadline, long long start, long long budget_us) {
+    deadline->state = state;
+    deadline->deadline = start + budget_us - state->deadline_reserve_us;
+    deadline->last_check = start;
+    deadline->last_nodes = state->nodes;
+    deadline->interval = 0;
+    deadline->adaptive = 1;
+    deadline->expired = 0;
+    deadline->saved_hook = state->yield_hook;
+    deadline->saved_context = state->yield_context;
+    deadline->saved_nodes = state->yield_nodes;
+    state->yield_hook = deadline_check;
+    state->yield_context = deadline;
+    state->yield_nodes = state->nodes + (state->deadline_nodes < DEADLINE_FIRST_NODES
+                                         ? (unsigned long long)state->deadline_nodes : DEADLINE_FIRST_NODES);
+    state->keep_partial = 1;
+}
+
+// Yield hook: stop unless the next clock read is still in time. The
+// first iteration always completes, so there is a move to play.
+void deadline_check(void* context) {
+    SearchDeadline* deadline = (SearchDeadline*)context;
+    ChessState* state = deadline->state;
+    long long now = get_time_us();
+    long long remaining = deadline->deadline - now;
+    unsigned long long nodes = state->nodes - deadline->last_nodes;
+    unsigned long long next = (unsigned long long)state->deadline_nodes;
+
+    deadline->interval = now - deadline->last_check;
+    deadline->last_check = now;
+    deadline->last_nodes = state->nodes;
+    if (state->root_count > 0 && remaining <= (deadline->adaptive ? deadline->interval : 0)) {
+        deadline->expired = 1;
+        state->stop = 1;
+        return;
+    }
+    if (deadline->adaptive && deadline->interval > 0 && remaining > 0) {
+        unsigned long long fit = (unsigned long long)(remaining / 4) * nodes / (unsigned long long)deadline->interval;
+        next = fit < next ? (fit > DEADLINE_MIN_NODES ? fit : DEADLINE_MIN_NODES) : next;
+    }
+    state->yield_nodes = state->nodes + next;
+}
+
+void deadline_end(ChessState* state, SearchDeadline* deadline) {
+    if (deadline->expired) {
+        state->stop = 0;    // Stopped by the deadline, not by the caller
+    }
+    state->yield_hook = deadline->saved_hook;
+    state->yield_context = deadline->saved_context;
+    state->yield_nodes = deadline->saved_nodes;
+    state->keep_partial = 0;
+}
+
+// Iteration hook of the benchmark: the deepest completed iteration and its move
+void deadline_probe(void* context, int depth, int score) {
+    DeadlineProbe* probe = (DeadlineProbe*)context;
+    (void)score;
+    probe->depth = depth;
+    probe->from = probe->state->best_from;
+    probe->to = probe->state->best_to;
+}
+
+int deadline_compare(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Replay positions (repeatable random walks from the bench positions)
+// against a deadline, with the clock read every 512, 2048 and 8192 nodes
+// at most, and once more every 2048 nodes exactly, stopping only when
+// the deadline has passed (no prediction). Prints CSV
+// with the mean deepest completed iteration, moves taken from an aborted
+// iteration, late replies, speed and percentiles of the overshoot (reply
+// time minus deadline, negative when early) in microseconds.
+void run_deadline(ChessState* state, int deadline_ms, int plies, int positions) {
+    static const int intervals[] = {512, 2048, 8192, 2048};
+    Move moves[MAX_MOVES];
+    int saved_nodes = state->deadline_nodes;
+
+    if (deadline_ms <= 0) {
+        deadline_ms = DEADLINE_MS;
+    }
+    if (plies <= 0 || plies > ANALYSIS_MAX_DEPTH) {
+        plies = ANALYSIS_MAX_DEPTH;
+    }
+    if (positions <= 0) {
+        positions = DEADLINE_POSITIONS;
+    }
+    unsigned char (*boards)[BOARD_SIZE] = malloc((size_t)positions * BOARD_SIZE);
+    int* enps = malloc((size_t)positions * sizeof(int));
+    int* colors = malloc((size_t)positions * sizeof(int));
+    long long* overshoot = malloc((size_t)positions * sizeof(long long));
+    if (!boards || !enps || !colors || !overshoot) {
+        printf("Out of memory\n");
+        free(boards);
+        free(enps);
+        free(colors);
+        free(overshoot);
+        return;
+    }
+
+    state->rand_seed = 1;
+    for (int i = 0; i < positions; i++) {
+        int color = load_fen(state, bench_positions[i % BENCH_POSITION_COUNT]);
+        int walk = get_random_byte(state) % (DEADLINE_WALK_PLIES + 1);
+        for (int ply = 0; ply < walk; ply++) {
+            int count = generate_moves(state, color, moves);
+            if (count == 0) {
+                break;
+            }
+            int pick = (get_random_byte(state) * count) >> 8;
+            if (get_piece_type(state->board[moves[pick].to]) == KING) {
+                break;
+            }
+            make_move(state, moves[pick].from, moves[pick].to);
+            color ^= COLOR_MASK;
+        }
+        memcpy(boards[i], state->board, BOARD_SIZE);
+        enps[i] = state->enp;
+        colors[i] = color;
+    }
+
+    printf("Deadline %d ms, %d positions, depth %d, %d threads\n", deadline_ms, positions, plies, helper_count + 1);
+    printf("check_nodes,adaptive,mean_depth,partial_pct,late,nodes_per_second,p50_us,p99_us,p999_us,max_us\n");
+    for (int row = 0; row < (int)(sizeof(intervals) / sizeof(intervals[0])); row++) {
+        int adaptive = row < (int)(sizeof(intervals) / sizeof(intervals[0])) - 1;
+        unsigned long long nodes = 0;
+        long long busy = 0;
+        long long depth_sum = 0;
+        int partial = 0;
+        int late = 0;
+
+        state->deadline_nodes = intervals[row];
+        clear_search_tables(state);
+        tt_clear();
+        for (int i = 0; i < positions; i++) {
+            SearchDeadline deadline;
+            DeadlineProbe probe = {state, 0, -1, -1};
+
+            memcpy(state->board, boards[i], BOARD_SIZE);
+            state->enp = enps[i];
+            state->iteration_hook = deadline_probe;
+            state->hook_context = &probe;
+            state->nodes = 0;
+            state->stop = 0;
+
+            long long start = get_time_us();
+            deadline_start(state, &deadline, start, deadline_ms * 1000LL);
+            deadline.adaptive = adaptive;
+            parallel_search(state, colors[i], plies * 2);
+            deadline_end(state, &deadline);
+            long long elapsed = get_time_us() - start;
+
+            overshoot[i] = elapsed - deadline_ms * 1000LL;
+            late += overshoot[i] > 0;
+            depth_sum += probe.depth;
+            partial += state->best_from >= 0 && (state->best_from != probe.from || state->best_to != probe.to);
+            nodes += total_nodes(state);
+            busy += elapsed;
+        }
+        qsort(overshoot, (size_t)positions, sizeof(long long), deadline_compare);
+        printf("%d,%d,%.2f,%.2f,%d,%llu,%lld,%lld,%lld,%lld\n", intervals[row], adaptive,
+               (double)depth_sum / positions, 100.0 * partial / positions, late,
+               nodes * 1000000 / (unsigned long long)(busy > 0 ? busy : 1), overshoot[(positions - 1) / 2],
+               overshoot[(int)((positions - 1) * 0.99)], overshoot[(int)((positions - 1) * 0.999)],
+               overshoot[positions - 1]);
+        fflush(stdout);
+    }
+
+    state->iteration_hook = NULL;
+    state->hook_context = NULL;
+    state->deadline_nodes = saved_nodes;
+    free(boards);
+    free(enps);
+    free(colors);
+    free(overshoot);
+}
+
+// Attack maps: for every square, how many pieces of each color could
+// capture there under generate_moves() rules (the squares least_attacker()
+// looks at). Own pieces count as defended, x-rays do not count. Rays
+// end where (square & ~0x77) is set: off the 0x88 board or the array.
+
+// Add delta to every square the piece on sq attacks
+void attack_piece(AttackMap* map, const unsigned char* board, int sq, unsigned char piece, int delta) {
+    unsigned char* counts = map->counts[get_piece_color(piece) >> 3];
+    int type = get_piece_type(piece);
+    int sliding = (type == ROOK || type == BISHOP || type == QUEEN);
+    int offset = offsets[type];
+    int count = (type == QUEEN || type == KING || type == KNIGHT) ? 8 : 4;
+
+    if (type == PAWN) {
+        offset = (get_piece_color(piece) == BLACK) ? DISP_PAWN_BLACK : DISP_PAWN_WHITE;
+    }
+    for (int d = 0; d < count; d++) {
+        int step = displacement[offset + d];
+        for (int to = sq + step; (to & ~0x77) == 0; to += step) {
+            counts[to] = (unsigned char)(counts[to] + delta);
+            if (!sliding || board[to] != EMPTY) {
+                break;
+            }
+        }
+    }
+}
+
+// Sliders whose rays reach sq: past it, add delta to their attacks (+1
+// when sq is emptied and the rays go on, -1 when it is filled and they stop)
+void attack_rays(AttackMap* map, const unsigned char* board, int sq, int delta) {
+    for (int d = 0; d < 8; d++) {
+        int step = displacement[DISP_KING + d];
+        int diagonal = (d >= 4);
+        int from = sq - step;
+
+        while ((from & ~0x77) == 0 && board[from] == EMPTY) {
+            from -= step;
+        }
+        if ((from & ~0x77) != 0) {
+            continue;
+        }
+        int type = get_piece_type(board[from]);
+        if (type != QUEEN && type != (diagonal ? BISHOP : ROOK)) {
+            continue;
+        }
+        unsigned char* counts = map->counts[get_piece_color(board[from]) >> 3];
+        for (int to = sq + step; (to & ~0x77) == 0; to += step) {
+            counts[to] = (unsigned char)(counts[to] + delta);
+            if (board[to] != EMPTY) {
+                break;
+            }
+        }
+    }
+}
+
+// Full computation from the board
+void attack_compute(AttackMap* map, const unsigned char* board) {
+    memset(map, 0, sizeof(AttackMap));
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        if ((sq & 0x88) == 0 && board[sq] != EMPTY) {
+            attack_piece(map, board, sq, board[sq], 1);
+        }
+    }
+}
+
+// Put piece (or EMPTY) on sq, updating only the attacks it changes: the
+// old and new occupant's, and the slider rays through sq when it is
+// emptied or filled. A move is two calls (to, then from); undoing it is
+// the same two calls in reverse with the old contents.
+void attack_set(AttackMap* map, unsigned char* board, int sq, unsigned char piece) {
+    unsigned char old = board[sq];
+
+    if (old != EMPTY) {
+        attack_piece(map, board, sq, old, -1);
+    }
+    // No ray can pass through a square nothing attacks
+    if ((old == EMPTY) != (piece == EMPTY) && (map->counts[0][sq] | map->counts[1][sq]) != 0) {
+        attack_rays(map, board, sq, piece == EMPTY ? 1 : -1);
+    }
+    board[sq] = piece;
+    if (piece != EMPTY) {
+        attack_piece(map, board, sq, piece, 1);
+    }
+}
+
+// Debug verifier: entries that differ from a full computation
+int attack_verify(const AttackMap* map, const unsigned char* board) {
+    AttackMap full;
+    int mismatches = 0;
+
+    attack_compute(&full, board);
+    for (int c = 0; c < 2; c++) {
+        for (int sq = 0; sq < BOARD_SIZE; sq++) {
+            mismatches += map->counts[c][sq] != full.counts[c][sq];
+        }
+    }
+    return mismatches;
+}
+
+// Node query of the benchmark: pieces of color (king aside) attacked and
+// not defended, from the map (full or incremental) or least_attacker()
+int attack_hanging(const ChessState* state, const AttackMap* map, int color, int method) {
+    AttackMap full;
+    unsigned long long pieces[2];
+    int own = color >> 3;
+    int hanging = 0;
+
+    if (method == ATTACK_FULL) {
+        attack_compute(&full, state->board);
+        map = &full;
+    }
+    piece_mask(state->board, color, pieces);
+    for (int sq; (sq = pop_square(pieces)) >= 0; ) {
+        if (get_piece_type(state->board[sq]) == KING) {
+            continue;
+        }
+        if (method == ATTACK_ON_DEMAND) {
+            hanging += least_attacker(state, sq, color ^ COLOR_MASK) >= 0 && least_attacker(state, sq, color) < 0;
+        } else {
+            hanging += map->counts[own ^ 1][sq] != 0 && map->counts[own][sq] == 0;
+        }
+    }
+    return hanging;
+}
+
+// Walk the move tree to depth (moves capturing a king end the line), with
+// the hanging piece query at every node. The incremental method updates
+// the map in make and unmake; verify checks it after each update.
+unsigned long long attack_walk(ChessState* state, AttackWalk* walk, int color, int depth) {
+    Move moves[MAX_MOVES];
+    unsigned long long nodes = 1;
+
+    int incremental = (walk->method == ATTACK_MAINTAIN || walk->method == ATTACK_INCREMENTAL);
+
+    if (walk->method != ATTACK_NONE && walk->method != ATTACK_MAINTAIN) {
+        walk->checksum += (unsigned long long)attack_hanging(state, &walk->map, color, walk->method);
+    }
+    if (depth == 0) {
+        return nodes;
+    }
+
+    int count = generate_moves(state, color, moves);
+    for (int i = 0; i < count; i++) {
+        int from = moves[i].from;
+        int to = moves[i].to;
+        unsigned char piece = state->board[from];
+        unsigned char captured = state->board[to];
+
+        if (get_piece_type(captured) == KING) {
+            continue;
+        }
+        if (incremental) {
+            attack_set(&walk->map, state->board, to, piece & PIECE_FULL_MASK);
+            attack_set(&walk->map, state->board, from, EMPTY);
+            if (walk->verify) {
+                walk->mismatches += (unsigned long long)attack_verify(&walk->map, state->board);
+            }
+        } else {
+            state->board[to] = piece & PIECE_FULL_MASK;
+            state->board[from] = EMPTY;
+        }
+
+        nodes += attack_walk(state, walk, color ^ COLOR_MASK, depth - 1);
+
+        if (incremental) {
+            attack_set(&walk->map, state->board, from, piece);
+            attack_set(&walk->map, state->board, to, captured);
+            if (walk->verify) {
+                walk->mismatches += (unsigned long long)attack_verify(&walk->map, state->board);
+            }
+        } else {
+            state->board[from] = piece;
+            state->board[to] = captured;
+        }
+    }
+    return nodes;
+}
+
+// Walk the bench positions to depth (default 4 plies) without attack
+// information, keeping the map up to date without querying it, then
+// with the hanging piece query answered by a full map computation per
+// node, by the incrementally kept map and by least_attacker() on demand.
+// Prints CSV with nodes, time, nanoseconds per node and a checksum of the
+// answers (equal for the three methods). verify checks the incremental
+// map against a full computation after every make and unmake.
+void run_attacks(ChessState* state, int depth, int verify) {
+    static const char* const method_names[ATTACK_METHODS] = {"walk", "maintain", "full", "incremental", "on_demand"};
+
+    if (depth <= 0) {
+        depth = ATTACK_DEPTH;
+    }
+    printf("method,nodes,ms,ns_per_node,checksum\n");
+    for (int method = 0; method < ATTACK_METHODS; method++) {
+        AttackWalk walk;
+        unsigned long long nodes = 0;
+
+        memset(&walk, 0, sizeof(walk));
+        walk.method = method;
+        walk.verify = verify && method == ATTACK_MAINTAIN;
+        long long start = get_time_us();
+        for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+            int color = load_fen(state, bench_positions[i]);
+            attack_compute(&walk.map, state->board);
+            nodes += attack_walk(state, &walk, color, depth);
+        }
+        long long elapsed = get_time_us() - start;
+        printf("%s,%llu,%lld,%.1f,%llu\n", method_names[method], nodes, elapsed / 1000,
+               1000.0 * (double)elapsed / (double)(nodes ? nodes : 1), walk.checksum);
+        if (walk.verify) {
+            printf("Verified after every make and unmake: %llu mismatches\n", walk.mismatches);
+        }
+        fflush(stdout);
+    }
+}
+
+// Squares 0-127 whose 0x88 bit is clear, per 64-square half
+#define ONBOARD_MASK 0x00FF00FF00FF00FFULL
+
+// Reference kernel: own pieces have (piece ^ color) & 0x0F in 1..6
+void piece_mask_scalar(const unsigned char* board, int color, unsigned long long mask[2]) {
+    mask[0] = mask[1] = 0;
+    for (int sq = 0; sq < BOARD_SIZE; sq++) {
+        int type = (board[sq] ^ color) & PIECE_FULL_MASK;
+        if (type >= PAWN && type <= KING) {
+            mask[sq >> 6] |= 1ULL << (sq & 63);
+        }
+    }
+    mask[0] &= ONBOARD_MASK;
+    mask[1] &= ONBOARD_MASK;
+}
+
+#ifdef CPU_DISPATCH
+// 16 squares per step: type - 1 must be in 0..5
+TARGET_SSE2 void piece_mask_sse2(const unsigned char* board, int color, unsigned long long mask[2]) {
+    const __m128i flip = _mm_set1_epi8((char)color);
+    const __m128i low = _mm_set1_epi8(PIECE_FULL_MASK);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i below = _mm_set1_epi8(-1);
+    const __m128i above = _mm_set1_epi8(KING - 1);
+
+    mask[0] = mask[1] = 0;
+    for (int i = 0; i < BOARD_SIZE / 16; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(board + i * 16));
+        v = _mm_sub_epi8(_mm_and_si128(_mm_xor_si128(v, flip), low), one);
+        __m128i own = _mm_andnot_si128(_mm_cmpgt_epi8(v, above), _mm_cmpgt_epi8(v, below));
+        mask[i >> 2] |= (unsigned long long)(unsigned int)_mm_movemask_epi8(own) << ((i & 3) * 16);
+    }
+    mask[0] &= ONBOARD_MASK;
+    mask[1] &= ONBOARD_MASK;
+}
+
+// 32 squares per step
+TARGET_AVX2 void piece_mask_avx2(const unsigned char* board, int color, unsigned long long mask[2]) {
+    const __m256i flip = _mm256_set1_epi8((char)color);
+    const __m256i low = _mm256_set1_epi8(PIECE_FULL_MASK);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i below = _mm256_set1_epi8(-1);
+    const __m256i above = _mm256_set1_epi8(KING - 1);
+
+    mask[0] = mask[1] = 0;
+    for (int i = 0; i < BOARD_SIZE / 32; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(board + i * 32));
+        v = _mm256_sub_epi8(_mm256_and_si256(_mm256_xor_si256(v, flip), low), one);
+        __m256i own = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, above), _mm256_cmpgt_epi8(v, below));
+        mask[i >> 1] |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(own) << ((i & 1) * 32);
+    }
+    mask[0] &= ONBOARD_MASK;
+    mask[1] &= ONBOARD_MASK;
+}
+#else
+// Other hosts only have the scalar kernel
+void piece_mask_sse2(const unsigned char* board, int color, unsigned long long mask[2]) {
+    piece_mask_scalar(board, color, mask);
+}
+
+void piece_mask_avx2(const unsigned char* board, int color, unsigned long long mask[2]) {
+    piece_mask_scalar(board, color, mask);
+}
+#endif
+
+// CPUID check for a kernel variant (AVX2 also needs OS support for YMM state)
+int cpu_supports_kernel(int variant) {
+    if (variant == KERNEL_SCALAR) {
+        return 1;
+    }
+#if defined(CPU_DISPATCH) && defined(__GNUC__)
+    __builtin_cpu_init();
+    return variant == KERNEL_SSE2 ? __builtin_cpu_supports("sse2") != 0 : __builtin_cpu_supports("avx2") != 0;
+#elif defined(CPU_DISPATCH) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 1);
+    if (variant == KERNEL_SSE2) {
+        return (regs[3] >> 26) & 1;
+    }
+    if (!((regs[2] >> 27) & 1) || (_xgetbv(0) & 6) != 6) {
+        return 0;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] >> 5) & 1;
+#else
+    return 0;
+#endif
+}
+
+void set_kernel(int variant) {
+    static const piece_mask_func kernels[KERNEL_COUNT] = {piece_mask_scalar, piece_mask_sse2, piece_mask_avx2};
+    kernel_variant = variant;
+    piece_mask = kernels[variant];
+}
+
+// Pick the best kernel the CPU supports, or the named one. Returns 0 if
+// the name is unknown or unsupported (the best kernel is used instead).
+int select_kernel(const char* name) {
+    int best = KERNEL_SCALAR;
+    for (int v = 0; v < KERNEL_COUNT; v++) {
+        if (cpu_supports_kernel(v)) {
+            best = v;
+        }
+    }
+    set_kernel(best);
+
+    if (name) {
+        for (int v = 0; v < KERNEL_COUNT; v++) {
+            if (strcmp(name, kernel_names[v]) == 0 && cpu_supports_kernel(v)) {
+                set_kernel(v);
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return 1;
+}
+
+// Remove and return the lowest square in the mask, or -1 when empty
+int pop_square(unsigned long long mask[2]) {
+    int half = mask[0] ? 0 : 1;
+    unsigned long long bits = mask[half];
+
+    if (bits == 0) {
+        return -1;
+    }
+    mask[half] = bits & (bits - 1);
+#if defined(__GNUC__)
+    return half * 64 + __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return half * 64 + (int)index;
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        index++;
+    }
+    return half * 64 + index;
+#endif
+}
+
+// Leaf nodes of the pseudo-legal move tree (the engine's generator, no
+// legality filter), with bulk counting at the last ply and an optional
+// hash of subtree counts (mask = entries - 1)
+unsigned long long perft(ChessState* state, int color, int depth, PerftHashEntry* hash, unsigned long long mask) {
+    Move moves[MAX_MOVES];
+    int count = generate_moves(state, color, moves);
+
+    if (depth <= 1) {
+        return depth == 1 ? (unsigned long long)count : 1;
+    }
+
+    unsigned long long key = 0;
+    if (hash) {
+        key = compute_hash(state) ^ (color ? zobrist_side : 0)
+            ^ ((unsigned long long)state->enp << 56) ^ ((unsigned long long)depth * 0x9E3779B97F4A7C15ULL);
+        PerftHashEntry* entry = &hash[key & mask];
+        if (entry->key == key) {
+            return entry->nodes;
+        }
+    }
+
+    unsigned char saved_board[BOARD_SIZE];
+    int saved_enp = state->enp;
+    unsigned long long nodes = 0;
+
+    memcpy(saved_board, state->board, BOARD_SIZE);
+    for (int i = 0; i < count; i++) {
+        make_move(state, moves[i].from, moves[i].to);
+        nodes += perft(state, color ^ COLOR_MASK, depth - 1, hash, mask);
+        memcpy(state->board, saved_board, BOARD_SIZE);
+        state->enp = saved_enp;
+    }
+
+    if (hash) {
+        hash[key & mask].key = key;
+        hash[key & mask].nodes = nodes;
+    }
+    return nodes;
+}
+
+// Pack the 64 squares as nibbles (piece and color; the moved flag does
+// not affect move generation)
+void perft_pack(const ChessState* state, int color, PerftRecord* record) {
+    memset(record, 0, sizeof(PerftRecord));
+    for (int i = 0; i < 64; i++) {
+        unsigned char piece = state->board[(i >> 3) * 16 + (i & 7)] & PIECE_FULL_MASK;
+        record->board[i >> 1] |= (unsigned char)(piece << ((i & 1) * 4));
+    }
+    record->color = (unsigned char)color;
+    record->enp = (unsigned char)state->enp;
+    record->count = 1;
+}
+
+// Set up a packed position; returns the side to move
+int perft_unpack(ChessState* state, const PerftRecord* record) {
+    create_board(state);
+    for (int i = 0; i < 64; i++) {
+        state->board[(i >> 3) * 16 + (i & 7)] = (record->board[i >> 1] >> ((i & 1) * 4)) & PIECE_FULL_MASK;
+    }
+    state->enp = record->enp;
+    return record->color;
+}
+
+int perft_compare(const void* a, const void* b) {
+    return memcmp(a, b, PERFT_KEY_BYTES);
+}
+
+// Sort the buffer, add up duplicates and write it as the next run file
+int perft_flush_run(PerftSplit* split) {
+    char path[300];
+    int unique = 0;
+
+    if (split->used == 0) {
+        return 1;
+    }
+    qsort(split->buffer, (size_t)split->used, sizeof(PerftRecord), perft_compare);
+    for (int i = 0; i < split->used; i++) {
+        if (unique > 0 && perft_compare(&split->buffer[unique - 1], &split->buffer[i]) == 0) {
+            split->buffer[unique - 1].count += split->buffer[i].count;
+        } else {
+            split->buffer[unique++] = split->buffer[i];
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/perft_run_%d.bin", split->dir, split->runs);
+    FILE* file = fopen(path, "wb");
+    int ok = file && fwrite(split->buffer, sizeof(PerftRecord), (size_t)unique, file) == (size_t)unique;
+    if (file && fclose(file) != 0) {
+        ok = 0;
+    }
+    split->runs++;
+    split->used = 0;
+    return ok;
+}
+
+// Walk the tree down to the split ply, collecting the positions reached.
+// Returns 0 as soon as a run cannot be written.
+int perft_split(ChessState* state, int color, int plies, PerftSplit* split) {
+    Move moves[MAX_MOVES];
+
+    if (plies == 0) {
+        if (split->used == split->capacity && !perft_flush_run(split)) {
+            return 0;
+        }
+        perft_pack(state, color, &split->buffer[split->used++]);
+        split->positions++;
+        return 1;
+    }
+
+    unsigned char saved_board[BOARD_SIZE];
+    int saved_enp = state->enp;
+    int count = generate_moves(state, color, moves);
+
+    memcpy(saved_board, state->board, BOARD_SIZE);
+    for (int i = 0; i < count; i++) {
+        make_move(state, moves[i].from, moves[i].to);
+        int ok = perft_split(state, color ^ COLOR_MASK, plies - 1, split);
+        memcpy(state->board, saved_board, BOARD_SIZE);
+        state->enp = saved_enp;
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Merge runs [first, last) into run output, adding the counts of equal
+// positions. The inputs are kept: the caller removes them once the
+// progress naming the output is saved. Returns 0 on I/O errors.
+int perft_merge_runs(const char* dir, int first, int last, int output, unsigned long long* unique) {
+    FILE* inputs[PERFT_MERGE_WAY];
+    PerftRecord heads[PERFT_MERGE_WAY];
+    int live[PERFT_MERGE_WAY];
+    int count = last - first;
+    char path[300];
+    int ok = 1;
+
+    snprintf(path, sizeof(path), "%s/perft_run_%d.bin", dir, output);
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/perft_run_%d.bin", dir, first + i);
+        inputs[i] = fopen(path, "rb");
+        live[i] = inputs[i] && fread(&heads[i], sizeof(PerftRecord), 1, inputs[i]) == 1;
+        if (!inputs[i]) {
+            ok = 0;
+        }
+    }
+
+    *unique = 0;
+    for (;;) {
+        int min = -1;
+        for (int i = 0; i < count; i++) {
+            if (live[i] && (min < 0 || perft_compare(&heads[i], &heads[min]) < 0)) {
+                min = i;
+            }
+        }
+        if (min < 0) {
+            break;
+        }
+        PerftRecord merged = heads[min];
+        merged.count = 0;
+        for (int i = 0; i < count; i++) {
+            while (live[i] && perft_compare(&heads[i], &merged) == 0) {
+                merged.count += heads[i].count;
+                live[i] = fread(&heads[i], sizeof(PerftRecord), 1, inputs[i]) == 1;
+            }
+        }
+        if (fwrite(&merged, sizeof(PerftRecord), 1, out) != 1) {
+            ok = 0;
+            break;
+        }
+        (*unique)++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (inputs[i]) {
+            fclose(inputs[i]);
+        }
+    }
+    if (fclose(out) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Delete runs [first, last)
+void perft_remove_runs(const char* dir, int first, int last) {
+    char path[300];
+
+    for (int i = first; i < last; i++) {
+        snprintf(path, sizeof(path), "%s/perft_run_%d.bin", dir, i);
+        remove(path);
+    }
+}
+
+// Count the subtrees of batch positions until none are left
+void perft_worker(void* arg) {
+    PerftWorker* worker = (PerftWorker*)arg;
+    PerftJob* job = worker->job;
+
+    for (;;) {
+        int index = ATOMIC_FETCH_ADD(&job->next, 1);
+        if (index >= job->count) {
+            break;
+        }
+        int color = perft_unpack(worker->state, &job->records[index]);
+        worker->nodes += job->records[index].count
+                       * perft(worker->state, color, job->depth, worker->hash, job->hash_entries - 1);
+    }
+}
+
+int perft_save_progress(const char* dir, const PerftProgress* progress) {
+    char path[300], temp_path[300];
+    snprintf(path, sizeof(path), "%s/perft.state", dir);
+    snprintf(temp_path, sizeof(temp_path), "%s/perft.state.tmp", dir);
+
+    FILE* file = fopen(temp_path, "w");
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "perft %d\ndepth %d\nsplit %d\nphase %d\nruns %d %d\n"
+            "unique %llu\npositions %llu\ndone %llu\nnodes %llu\n",
+            PERFT_STATE_VERSION, progress->depth, progress->split, progress->phase, progress->first_run,
+            progress->next_run, progress->unique, progress->positions, progress->done, progress->nodes);
+    if (fclose(file) != 0) {
+        return 0;
+    }
+#ifndef UNIVAC
+    return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return rename(temp_path, path) == 0;
+#endif
+}
+
+int perft_load_progress(const char* dir, PerftProgress* progress) {
+    char path[300];
+    int version = 0;
+    snprintf(path, sizeof(path), "%s/perft.state", dir);
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    int fields = fscanf(file, "perft %d depth %d split %d phase %d runs %d %d "
+                        "unique %llu positions %llu done %llu nodes %llu",
+                        &version, &progress->depth, &progress->split, &progress->phase, &progress->first_run,
+                        &progress->next_run, &progress->unique, &progress->positions, &progress->done,
+                        &progress->nodes);
+    fclose(file);
+    return fields == 10 && version == PERFT_STATE_VERSION;
+}
+
+// Perft from the initial position. Without a split ply it runs in memory
+// with the hash table budget. With one, the tree is cut at that ply: the
+// positions reached are written to sorted runs (deduplicated within the
+// memory budget), merged on disk into unique positions with path counts,
+// and each unique position's subtree is counted by -threads workers (all
+// processors by default) with a private hash each. Progress is saved in
+// <dir>/perft.state after every run, merge pass and batch, and the same
+// command resumes from it.
+void run_perft(ChessState* state, int depth, int split_ply, const char* dir) {
+    unsigned long long budget = (unsigned long long)state->memory_kb * 1024;
+    PerftProgress progress;
+    char path[300];
+    int workers = 1;
+
+#if !defined(UNIVAC) || defined(POSIX)
+    workers = state->threads > 1 ? state->threads : cpu_count();
+    if (workers > MAX_THREADS) {
+        workers = MAX_THREADS;
+    }
+#endif
+    if (depth < 1) {
+        depth = 1;
+    }
+    long long start = get_time_ms();
+
+    if (split_ply <= 0 || split_ply >= depth) {
+        unsigned long long entries = 1;
+        while (entries * 2 * sizeof(PerftHashEntry) <= budget) {
+            entries *= 2;
+        }
+        PerftHashEntry* hash = (PerftHashEntry*)calloc((size_t)entries, sizeof(PerftHashEntry));
+        init_chess(state);
+        unsigned long long nodes = perft(state, WHITE, depth, hash, entries - 1);
+        long long elapsed = get_time_ms() - start;
+        printf("perft %d: %llu nodes in %lld ms\n", depth, nodes, elapsed);
+        free(hash);
+        return;
+    }
+
+    if (perft_load_progress(dir, &progress) && progress.depth == depth && progress.split == split_ply) {
+        printf("Resuming perft %d (split %d) in phase %d\n", depth, split_ply, progress.phase);
+    } else {
+        memset(&progress, 0, sizeof(progress));
+        progress.depth = depth;
+        progress.split = split_ply;
+        progress.phase = PERFT_SPLIT;
+    }
+
+    // Split: sorted, locally deduplicated runs of the split ply positions.
+    // An interrupted split starts over.
+    if (progress.phase == PERFT_SPLIT) {
+        PerftSplit split;
+        memset(&split, 0, sizeof(split));
+        split.dir = dir;
+        split.capacity = (int)(budget / sizeof(PerftRecord));
+        split.capacity = split.capacity < 1024 ? 1024 : split.capacity;
+        split.buffer = (PerftRecord*)malloc((size_t)split.capacity * sizeof(PerftRecord));
+        if (!split.buffer) {
+            printf("Out of memory\n");
+            return;
+        }
+        init_chess(state);
+        int ok = perft_split(state, WHITE, split_ply, &split) && perft_flush_run(&split);
+        free(split.buffer);
+        if (!ok) {
+            printf("Cannot write runs to %s\n", dir);
+            return;
+        }
+        progress.positions = split.positions;
+        progress.first_run = 0;
+        progress.next_run = split.runs;
+        progress.phase = PERFT_MERGE;
+        perft_save_progress(dir, &progress);
+        printf("Split at ply %d: %llu positions in %d runs (%lld ms)\n", split_ply, split.positions, split.runs,
+               get_time_ms() - start);
+    }
+
+    // Merge passes of up to PERFT_MERGE_WAY runs until one is left
+    while (progress.phase == PERFT_MERGE) {
+        if (progress.next_run - progress.first_run <= 1) {
+            // The last run holds the unique positions (none if nothing reached the split ply)
+            progress.unique = 0;
+            snprintf(path, sizeof(path), "%s/perft_run_%d.bin", dir, progress.first_run);
+            FILE* file = progress.next_run > progress.first_run ? fopen(path, "rb") : NULL;
+            if (file) {
+                long long size = FILE_SEEK(file, 0, SEEK_END) == 0 ? FILE_TELL(file) : -1;
+                fclose(file);
+                if (size < 0) {
+                    printf("Cannot read %s\n", path);
+                    return;
+                }
+                progress.unique = (unsigned long long)size / sizeof(PerftRecord);
+            }
+            progress.phase = PERFT_COUNT;
+            perft_save_progress(dir, &progress);
+            printf("Unique positions: %llu of %llu (%lld ms)\n", progress.unique, progress.positions,
+                   get_time_ms() - start);
+            break;
+        }
+        int last = progress.first_run + PERFT_MERGE_WAY;
+        last = last > progress.next_run ? progress.next_run : last;
+        if (!perft_merge_runs(dir, progress.first_run, last, progress.next_run, &progress.unique)) {
+            printf("Merging runs in %s failed\n", dir);
+            return;
+        }
+        // Inputs go only once the saved progress no longer needs them
+        int merged = progress.first_run;
+        progress.first_run = last;
+        progress.next_run++;
+        if (!perft_save_progress(dir, &progress)) {
+            printf("Cannot save progress to %s\n", dir);
+            return;
+        }
+        perft_remove_runs(dir, merged, last);
+    }
+
+    // Count the unique positions in checkpointed batches
+    if (progress.phase == PERFT_COUNT) {
+        static PerftJob job;
+        static PerftWorker worker_data[MAX_THREADS];
+        thread_handle threads[MAX_THREADS];
+        unsigned long long entries = 1;
+        int started = 0;
+
+        while (entries * 2 * sizeof(PerftHashEntry) * (unsigned long long)workers <= budget) {
+            entries *= 2;
+        }
+        job.records = (PerftRecord*)malloc(PERFT_BATCH * sizeof(PerftRecord));
+        job.depth = depth - split_ply;
+        job.hash_entries = entries;
+        for (int w = 0; w < workers; w++) {
+            worker_data[w].job = &job;
+            worker_data[w].state = (ChessState*)calloc(1, sizeof(ChessState));
+            worker_data[w].hash = (PerftHashEntry*)calloc((size_t)entries, sizeof(PerftHashEntry));
+            if (!worker_data[w].state || !worker_data[w].hash) {
+                printf("Out of memory\n");
+                return;
+            }
+        }
+
+        snprintf(path, sizeof(path), "%s/perft_run_%d.bin", dir, progress.first_run);
+        FILE* file = progress.unique ? fopen(path, "rb") : NULL;
+        if (progress.unique && (!file || FILE_SEEK(file, progress.done * sizeof(PerftRecord), SEEK_SET) != 0)) {
+            printf("Cannot read %s\n", path);
+            return;
+        }
+
+        while (progress.done < progress.unique) {
+            job.count = (int)fread(job.records, sizeof(PerftRecord), PERFT_BATCH, file);
+            if (job.count <= 0) {
+                printf("Unique positions file %s is short\n", path);
+                break;
+            }
+            job.next = 0;
+            started = 0;
+            for (int w = 0; w < workers; w++) {
+                worker_data[w].nodes = 0;
+                if (thread_start(&threads[started], perft_worker, &worker_data[w])) {
+                    started++;
+                }
+            }
+            for (int w = 0; w < started; w++) {
+                thread_join(threads[w]);
+            }
+            for (int w = 0; w < workers; w++) {
+                progress.nodes += worker_data[w].nodes;
+            }
+            progress.done += (unsigned long long)job.count;
+            perft_save_progress(dir, &progress);
+        }
+        if (file) {
+            fclose(file);
+        }
+        for (int w = 0; w < workers; w++) {
+            free(worker_data[w].state);
+            free(worker_data[w].hash);
+        }
+        free(job.records);
+        if (progress.done >= progress.unique) {
+            progress.phase = PERFT_DONE;
+            perft_save_progress(dir, &progress);
+        }
+    }
+
+    if (progress.phase == PERFT_DONE) {
+        printf("perft %d: %llu nodes (split %d, %llu unique of %llu positions, %d workers, %lld ms)\n", depth,
+               progress.nodes, split_ply, progress.unique, progress.positions, workers, get_time_ms() - start);
+    }
+}
+
+// Deadline and weight of each priority: urgent sessions (bullet games)
+// get short deadlines and a larger share of the nodes
+static const int sched_deadline_ms[SCHED_PRIORITIES] = { 100, 300, 1000 };
+static const int sched_weight[SCHED_PRIORITIES] = { 4, 2, 1 };
+
+// Binary min-heap of tasks by key
+void sched_push(SchedTask** heap, int* count, SchedTask* task) {
+    int i = (*count)++;
+    while (i > 0 && heap[(i - 1) / 2]->key > task->key) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = task;
+}
+
+SchedTask* sched_pop(SchedTask** heap, int* count) {
+    if (*count == 0) {
+        return NULL;
+    }
+    SchedTask* top = heap[0];
+    SchedTask* last = heap[--(*count)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *count) {
+            break;
+        }
+        if (child + 1 < *count && heap[child + 1]->key < heap[child]->key) {
+            child++;
+        }
+        if (heap[child]->key >= last->key) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*count > 0) {
+        heap[i] = last;
+    }
+    return top;
+}
+
+// Node count of the next yield: a quantum on, or the end of the budget
+unsigned long long sched_next_yield(const SchedTask* task) {
+    unsigned long long next = task->state->nodes + SCHED_QUANTUM;
+    unsigned long long limit = task->search_nodes + task->budget;
+
+    if (task->budget && limit > task->state->nodes && limit < next) {
+        next = limit;
+    }
+    return next;
+}
+
+// Search yield hook: stop at the deadline, or at the node budget once the
+// minimum depth is complete, otherwise give the worker back
+void sched_task_yield(void* context) {
+    SchedTask* task = (SchedTask*)context;
+    ChessState* state = task->state;
+    unsigned long long used = state->nodes - task->search_nodes;
+
+    state->yield_nodes = sched_next_yield(task);
+    if (get_time_ms() >= task->deadline) {
+        state->stop = 1;
+        task->deadline_stop = 1;
+        return;
+    }
+    if (task->budget && used >= task->budget && task->completed_depth >= state->effort_min_depth) {
+        state->stop = 1;
+        task->budget_stop = 1;
+        return;
+    }
+#ifndef UNIVAC
+    SwitchToFiber(task->worker->fiber);
+#elif defined(POSIX)
+    swapcontext(&task->context, &task->worker->context);
+#endif
+}
+
+// Iteration hook: the depth the budget may not cut into
+void sched_iteration(void* context, int depth, int score) {
+    SchedTask* task = (SchedTask*)context;
+    task->completed_depth = depth;
+    (void)score;
+}
+
+// Coroutine body: the whole search, then back to the worker for good
+#ifndef UNIVAC
+VOID WINAPI sched_task_entry(LPVOID param) {
+    SchedTask* task = (SchedTask*)param;
+#elif defined(POSIX)
+void sched_task_entry(unsigned int high, unsigned int low) {
+    SchedTask* task = (SchedTask*)(size_t)(((unsigned long long)high << 32) | low);
+#else
+void sched_task_entry(SchedTask* task) {
+#endif
+    iterative_search(task->state, task->color, task->worker->sched->depth);
+    task->finished = 1;
+#ifndef UNIVAC
+    SwitchToFiber(task->worker->fiber);
+#elif defined(POSIX)
+    swapcontext(&task->context, &task->worker->context);
+#endif
+}
+
+// Run a slice of the task's search: until it yields or returns. Builds
+// without coroutines run each search to the end in one slice.
+void sched_resume(SchedWorker* worker, SchedTask* task) {
+    Scheduler* sched = worker->sched;
+
+    task->worker = worker;
+    task->state->thread_id = worker->index;     // Log ring of the running thread
+    task->slice_nodes = task->state->nodes;
+    task->state->yield_nodes = sched_next_yield(task);
+
+#ifndef UNIVAC
+    if (!task->fiber) {
+        task->fiber = CreateFiber(SCHED_STACK, sched_task_entry, task);
+    }
+    SwitchToFiber(task->fiber);
+    if (task->finished) {
+        DeleteFiber(task->fiber);
+        task->fiber = NULL;
+    }
+#elif defined(POSIX)
+    if (!task->stack) {
+        mutex_lock(&sched->lock);
+        task->stack = sched->free_count > 0 ? sched->free_stacks[--sched->free_count] : NULL;
+        mutex_unlock(&sched->lock);
+        if (!task->stack) {
+            task->stack = malloc(SCHED_STACK);
+        }
+        unsigned long long address = (unsigned long long)(size_t)task;
+        getcontext(&task->context);
+        task->context.uc_stack.ss_sp = task->stack;
+        task->context.uc_stack.ss_size = SCHED_STACK;
+        task->context.uc_link = NULL;
+        makecontext(&task->context, (void (*)(void))sched_task_entry, 2,
+                    (unsigned int)(address >> 32), (unsigned int)address);
+    }
+    swapcontext(&worker->context, &task->context);
+    if (task->finished) {
+        mutex_lock(&sched->lock);
+        sched->free_stacks[sched->free_count++] = task->stack;
+        mutex_unlock(&sched->lock);
+        task->stack = NULL;
+    }
+#else
+    (void)sched;
+    sched_task_entry(task);   // The hook still applies deadlines and budgets
+#endif
+}
+
+// A session's human has moved: queue its search (lock held)
+void sched_begin_search(Scheduler* sched, SchedTask* task) {
+    task->arrival = task->wake;
+    task->deadline = task->arrival + sched_deadline_ms[task->priority];
+    task->started = 0;
+    task->finished = 0;
+    task->deadline_stop = 0;
+    task->budget_stop = 0;
+    task->completed_depth = 0;
+    task->search_nodes = task->state->nodes;
+    task->budget = (unsigned long long)sched->params->effort_knodes * 10 * (unsigned long long)sched->effort;
+    task->state->stop = 0;
+    task->status = SCHED_READY;
+
+    // A session back from waiting does not get the time it missed
+    if (task->vtime < sched->vclock) {
+        task->vtime = sched->vclock;
+    }
+    task->key = task->vtime;
+    sched_push(sched->ready, &sched->ready_count, task);
+    if (sched->ready_count > sched->peak_ready) {
+        sched->peak_ready = sched->ready_count;
+    }
+}
+
+// Search done: record latency, play the engine move and a random reply,
+// and wait for the next human move (lock held)
+void sched_end_search(Scheduler* sched, SchedTask* task, long long now) {
+    ChessState* state = task->state;
+    long long latency = now - task->arrival;
+    Move moves[MAX_MOVES];
+
+    sched->searches++;
+    sched->counts[task->priority]++;
+    sched->histogram[task->priority][latency < SCHED_HISTOGRAM_MS ? latency : SCHED_HISTOGRAM_MS]++;
+    if (latency > sched->max_latency[task->priority]) {
+        sched->max_latency[task->priority] = latency;
+    }
+    if (task->deadline_stop) {
+        sched->deadline_stops++;
+    }
+    if (task->budget_stop) {
+        sched->budget_stops++;
+    }
+    sched->window_searches++;
+    if (now > task->deadline) {
+        sched->overshoot_ms += now - task->deadline;
+        sched->window_late++;
+    }
+
+    int over = state->best_from < 0 || task->ply >= SCHED_MAX_PLIES;
+    if (!over) {
+        make_move(state, state->best_from, state->best_to);
+        int count = generate_moves(state, task->color ^ COLOR_MASK, moves);
+        if (count > 0) {
+            int pick = ((get_random_byte(state) << 8) | get_random_byte(state)) % count;
+            make_move(state, moves[pick].from, moves[pick].to);
+            task->ply += 2;
+        } else {
+            over = 1;
+        }
+    }
+    if (over) {
+        init_chess(state);
+        task->ply = 0;
+    }
+
+    int think = ((get_random_byte(state) << 8) | get_random_byte(state)) % (2 * SCHED_THINK_MS + 1);
+    task->wake = now + think;
+    task->key = task->wake;
+    task->status = SCHED_WAITING;
+    sched_push(sched->waiting, &sched->waiting_count, task);
+}
+
+// Effort controller, once per period (lock held): cut the node budget by
+// a quarter while searches queue up or more than 1% miss their deadline,
+// give back a tenth of full effort once the queue has drained and none
+// are late. Every period is logged (-log) as a metrics record.
+void sched_control(Scheduler* sched, int worker, long long now) {
+    const ChessState* params = sched->params;
+    int late = sched->window_searches ? (int)(100 * sched->window_late / sched->window_searches) : 0;
+    int decision = 0;   // 0 = hold, 1 = down, 2 = up
+
+    if (params->effort_control) {
+        if (sched->ready_count > SCHED_QUEUE_HIGH * sched->worker_count
+            || sched->window_late * 100 > sched->window_searches) {
+            int effort = sched->effort * 3 / 4;
+            effort = effort < params->effort_floor ? params->effort_floor : effort;
+            if (effort < sched->effort) {
+                sched->effort = effort;
+                sched->decreases++;
+                decision = 1;
+            }
+        } else if (sched->ready_count <= sched->worker_count && sched->window_late == 0 && sched->effort < 100) {
+            sched->effort = sched->effort + 10 > 100 ? 100 : sched->effort + 10;
+            sched->increases++;
+            decision = 2;
+        }
+    }
+    if (sched->effort < sched->min_effort) {
+        sched->min_effort = sched->effort;
+    }
+    sched->effort_sum += (unsigned long long)sched->effort;
+    sched->periods++;
+    if (async_log) {
+        log_push_effort(worker, sched->effort, decision, sched->ready_count, late,
+                        (unsigned long long)params->effort_knodes * 10 * (unsigned long long)sched->effort);
+    }
+    sched->window_searches = 0;
+    sched->window_late = 0;
+    sched->next_control = now + SCHED_CONTROL_MS;
+}
+
+// Worker: start the searches that are due, run the most deserving ready
+// search for a slice, account for it, repeat until the load ends
+void sched_worker(void* arg) {
+    SchedWorker* worker = (SchedWorker*)arg;
+    Scheduler* sched = worker->sched;
+
+#ifndef UNIVAC
+    worker->fiber = ConvertThreadToFiber(NULL);
+#endif
+    for (;;) {
+        mutex_lock(&sched->lock);
+        long long now = get_time_ms();
+        if (now >= sched->next_control) {
+            sched_control(sched, worker->index, now);
+        }
+        while (now < sched->end && sched->waiting_count > 0 && sched->waiting[0]->key <= now) {
+            sched_begin_search(sched, sched_pop(sched->waiting, &sched->waiting_count));
+        }
+        SchedTask* task = sched_pop(sched->ready, &sched->ready_count);
+        if (task) {
+            task->status = SCHED_RUNNING;
+            sched->vclock = task->vtime > sched->vclock ? task->vtime : sched->vclock;
+            if (!task->started) {
+                task->started = 1;
+                sched->active++;
+                sched->peak_active = sched->active > sched->peak_active ? sched->active : sched->peak_active;
+            }
+        }
+        int done = !task && now >= sched->end && sched->active == 0;
+        mutex_unlock(&sched->lock);
+
+        if (done) {
+            break;
+        }
+        if (!task) {
+#ifndef UNIVAC
+            Sleep(1);
+#elif defined(POSIX)
+            usleep(1000);
+#endif
+            continue;
+        }
+
+        sched_resume(worker, task);
+        unsigned long long used = task->state->nodes - task->slice_nodes;
+
+        mutex_lock(&sched->lock);
+        sched->slices++;
+        task->vtime += (long long)(used * sched_weight[0] / sched_weight[task->priority]);
+        if (task->finished) {
+            sched->active--;
+            sched_end_search(sched, task, get_time_ms());
+        } else {
+            task->key = task->vtime;
+            task->status = SCHED_READY;
+            sched_push(sched->ready, &sched->ready_count, task);
+        }
+        mutex_unlock(&sched->lock);
+    }
+#ifndef UNIVAC
+    ConvertFiberToThread();
+#endif
+}
+
+// Latency (ms) below which the given fraction of searches completed, for
+// one priority or all (-1)
+long long sched_percentile(const Scheduler* sched, int priority, double fraction) {
+    unsigned long long total = 0, seen = 0;
+
+    for (int p = 0; p < SCHED_PRIORITIES; p++) {
+        if (priority < 0 || p == priority) {
+            total += sched->counts[p];
+        }
+    }
+    unsigned long long target = (unsigned long long)(fraction * (double)total);
+    for (int ms = 0; ms <= SCHED_HISTOGRAM_MS; ms++) {
+        for (int p = 0; p < SCHED_PRIORITIES; p++) {
+            if (priority < 0 || p == priority) {
+                seen += sched->histogram[p][ms];
+            }
+        }
+        if (seen > target) {
+            return ms;
+        }
+    }
+    return SCHED_HISTOGRAM_MS;
+}
+
+// Synthetic server load: sessions wait a random human think time, then
+// need a search with their priority's deadline. Searches are coroutines
+// time-sliced over -threads workers (all processors by default) in
+// weighted fair order; the report gives throughput and latency tails
+// from the human move to the engine's reply.
+void run_sched(ChessState* state, int sessions, int seconds, int plies) {
+    static Scheduler sched;
+    static SchedWorker workers[MAX_THREADS];
+    thread_handle threads[MAX_THREADS];
+    int worker_count = 1;
+    int started = 0;
+
+    if (sessions <= 0) {
+        sessions = SCHED_SESSIONS;
+    }
+    if (seconds <= 0) {
+        seconds = SCHED_SECONDS;
+    }
+    if (plies <= 0) {
+        plies = SCHED_PLIES;
+    }
+#if !defined(UNIVAC) || defined(POSIX)
+    worker_count = state->threads > 1 ? state->threads : cpu_count();
+    if (worker_count > MAX_THREADS) {
+        worker_count = MAX_THREADS;
+    }
+#endif
+
+    memset(&sched, 0, sizeof(sched));
+    mutex_init(&sched.lock);
+    sched.depth = plies * 2;
+    sched.worker_count = worker_count;
+    sched.params = state;
+    sched.effort = 100;
+    sched.min_effort = 100;
+    sched.task_count = sessions;
+    sched.tasks = (SchedTask*)calloc((size_t)sessions, sizeof(SchedTask));
+    sched.ready = (SchedTask**)malloc((size_t)sessions * sizeof(SchedTask*));
+    sched.waiting = (SchedTask**)malloc((size_t)sessions * sizeof(SchedTask*));
+    sched.free_stacks = (void**)malloc((size_t)sessions * sizeof(void*));
+    if (!sched.tasks || !sched.ready || !sched.waiting || !sched.free_stacks) {
+        printf("Out of memory\n");
+        return;
+    }
+
+    tt_clear();
+    sched.start = get_time_ms();
+    sched.end = sched.start + (long long)seconds * 1000;
+    sched.next_control = sched.start + SCHED_CONTROL_MS;
+    for (int i = 0; i < sessions; i++) {
+        SchedTask* task = &sched.tasks[i];
+        task->state = (ChessState*)malloc(sizeof(ChessState));
+        if (!task->state) {
+            printf("Out of memory\n");
+            return;
+        }
+        // Sessions share the parameters and the hash table, nothing else
+        memcpy(task->state, state, sizeof(ChessState));
+        task->state->cont_hist = NULL;
+        task->state->tree_dump = NULL;
+        task->state->iteration_hook = sched_iteration;
+        task->state->hook_context = task;
+        task->state->yield_hook = sched_task_yield;
+        task->state->yield_context = task;
+        task->state->rand_seed = state->rand_seed + (unsigned int)i * 2654435761u;
+        clear_search_tables(task->state);
+        init_chess(task->state);
+        task->priority = i % SCHED_PRIORITIES;
+        task->color = WHITE;
+        task->wake = sched.start + (get_random_byte(task->state) * SCHED_THINK_MS) / 255;
+        task->key = task->wake;
+        sched_push(sched.waiting, &sched.waiting_count, task);
+    }
+
+    printf("Scheduler: %d sessions, %d workers, %d s, depth %d, %d-node slices, %d ms mean think time\n",
+           sessions, worker_count, seconds, plies, SCHED_QUANTUM, SCHED_THINK_MS);
+    printf("Effort    : %s, %d knodes per search, floor %d%%, minimum depth %d\n",
+           state->effort_control ? "adaptive" : "fixed", state->effort_knodes, state->effort_floor,
+           state->effort_min_depth);
+
+    for (int w = 0; w < worker_count; w++) {
+        workers[w].sched = &sched;
+        workers[w].index = w;
+        if (thread_start(&threads[started], sched_worker, &workers[w])) {
+            started++;
+        }
+    }
+    for (int w = 0; w < started; w++) {
+        thread_join(threads[w]);
+    }
+    long long elapsed = get_time_ms() - sched.start;
+
+    unsigned long long nodes = 0;
+    for (int i = 0; i < sessions; i++) {
+        nodes += sched.tasks[i].state->nodes;
+        free(sched.tasks[i].state);
+    }
+    double seconds_run = elapsed > 0 ? elapsed / 1000.0 : 1.0;
+    printf("Searches  : %llu in %lld ms (%.1f/s), %llu nodes (%.0f nodes/s)\n", sched.searches, elapsed,
+           sched.searches / seconds_run, nodes, nodes / seconds_run);
+    printf("Slices    : %llu (%.1f per search), peak %d ready, %d searches in flight\n", sched.slices,
+           sched.searches ? (double)sched.slices / sched.searches : 0.0, sched.peak_ready, sched.peak_active);
+    printf("Deadlines : %llu searches stopped by their deadline, %lld ms total overshoot\n",
+           sched.deadline_stops, sched.overshoot_ms);
+    printf("Budget    : %llu searches stopped by their budget; effort average %llu%%, lowest %d%%, final %d%% "
+           "(%u cuts, %u raises)\n", sched.budget_stops, sched.periods ? sched.effort_sum / sched.periods : 100,
+           sched.min_effort, sched.effort, sched.decreases, sched.increases);
+    printf("Latency ms  deadline  searches    p50    p99  p99.9    max\n");
+    for (int p = -1; p < SCHED_PRIORITIES; p++) {
+        unsigned long long count = 0;
+        long long max = 0;
+        for (int q = 0; q < SCHED_PRIORITIES; q++) {
+            if (p < 0 || q == p) {
+                count += sched.counts[q];
+                max = sched.max_latency[q] > max ? sched.max_latency[q] : max;
+            }
+        }
+        if (p < 0) {
+            printf("all                   ");
+        } else {
+            printf("priority %d  %8d  ", p, sched_deadline_ms[p]);
+        }
+        printf("%8llu %6lld %6lld %6lld %6lld\n", count, sched_percentile(&sched, p, 0.5),
+               sched_percentile(&sched, p, 0.99), sched_percentile(&sched, p, 0.999), max);
+    }
+
+    for (int i = 0; i < sched.free_count; i++) {
+        free(sched.free_stacks[i]);
+    }
+    free(sched.free_stacks);
+    free(sched.waiting);
+    free(sched.ready);
+    free(sched.tasks);
+    mutex_destroy(&sched.lock);
+}
+
+// Update text: a header line, plus the board for moves
+int broadcast_encode(const unsigned char* board, const char* line, int keyframe, char* out) {
+    int length = snprintf(out, 64, "%s\n", line);
+    if (keyframe) {
+        length += format_board(board, out + length);
+        out[length++] = '\n';
+    }
+    return length;
+}
+
+#if defined(UNIVAC) && defined(POSIX)
+void broadcast_release(BroadcastHub* hub, BroadcastMessage* message) {
+    if (message && --message->refs == 0) {
+        free(message);
+        hub->live_messages--;
+    }
+}
+
+// Add an update to the ring (dropping the oldest) and, for a board, make
+// it the one late spectators resume from
+void broadcast_publish(BroadcastHub* hub, const char* text, int length, int keyframe) {
+    BroadcastMessage* message = (BroadcastMessage*)malloc(sizeof(BroadcastMessage));
+    if (!message) {
+        return;
+    }
+    message->refs = 1;
+    message->keyframe = keyframe;
+    message->seq = hub->next_seq++;
+    message->length = length < BROADCAST_MESSAGE ? length : BROADCAST_MESSAGE;
+    memcpy(message->data, text, (size_t)message->length);
+    hub->live_messages++;
+
+    int slot = (int)(message->seq & (BROADCAST_RING - 1));
+    broadcast_release(hub, hub->ring[slot]);
+    hub->ring[slot] = message;
+    if (keyframe) {
+        broadcast_release(hub, hub->keyframe);
+        hub->keyframe = message;
+        message->refs++;
+    }
+}
+
+// Update by sequence number, NULL once it has left the ring
+BroadcastMessage* broadcast_message(const BroadcastHub* hub, unsigned long long seq) {
+    if (hub->keyframe && hub->keyframe->seq == seq) {
+        return hub->keyframe;
+    }
+    BroadcastMessage* message = hub->ring[seq & (BROADCAST_RING - 1)];
+    return message && message->seq == seq ? message : NULL;
+}
+
+// New spectators start from the latest board
+int broadcast_add(BroadcastHub* hub, int fd) {
+    if (hub->count == hub->capacity) {
+        int capacity = hub->capacity ? hub->capacity * 2 : 64;
+        Spectator* spectators = (Spectator*)realloc(hub->spectators, (size_t)capacity * sizeof(Spectator));
+        if (!spectators) {
+            return 0;
+        }
+        hub->spectators = spectators;
+        hub->capacity = capacity;
+    }
+    Spectator* spectator = &hub->spectators[hub->count++];
+    memset(spectator, 0, sizeof(Spectator));
+    spectator->fd = fd;
+    spectator->next_seq = hub->keyframe ? hub->keyframe->seq : hub->next_seq;
+    return 1;
+}
+
+void broadcast_remove(BroadcastHub* hub, int index) {
+    Spectator* spectator = &hub->spectators[index];
+    close(spectator->fd);
+    broadcast_release(hub, spectator->partial);
+    free(spectator->queue);
+    hub->spectators[index] = hub->spectators[--hub->count];
+}
+
+// Send what the spectator has not had yet, straight from the shared
+// messages, without blocking. A spectator more than BROADCAST_MAX_LAG
+// updates behind jumps to the latest board instead of queueing. Returns
+// 0 when the connection is gone.
+int broadcast_send(BroadcastHub* hub, Spectator* spectator) {
+    for (;;) {
+        struct iovec iov[BROADCAST_IOV];
+        BroadcastMessage* messages[BROADCAST_IOV];
+        struct msghdr header;
+        int count = 0;
+        size_t total = 0;
+
+        if (!spectator->partial && hub->next_seq - spectator->next_seq > BROADCAST_MAX_LAG) {
+            unsigned long long resume = hub->keyframe && hub->keyframe->seq > spectator->next_seq
+                                      ? hub->keyframe->seq : hub->next_seq - BROADCAST_RING / 2;
+            if (resume > spectator->next_seq) {
+                spectator->skipped += resume - spectator->next_seq;
+                hub->skipped += resume - spectator->next_seq;
+                spectator->next_seq = resume;
+            }
+        }
+
+        if (spectator->partial) {
+            messages[count] = spectator->partial;
+            iov[count].iov_base = spectator->partial->data + spectator->offset;
+            iov[count].iov_len = (size_t)(spectator->partial->length - spectator->offset);
+            total += iov[count++].iov_len;
+        }
+        for (unsigned long long seq = spectator->next_seq; count < BROADCAST_IOV && seq < hub->next_seq; seq++) {
+            BroadcastMessage* message = broadcast_message(hub, seq);
+            if (!message) {
+                break;
+            }
+            messages[count] = message;
+            iov[count].iov_base = message->data;
+            iov[count].iov_len = (size_t)message->length;
+            total += iov[count++].iov_len;
+        }
+        if (count == 0) {
+            return 1;
+        }
+
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = iov;
+        header.msg_iovlen = (size_t)count;
+        ssize_t sent = sendmsg(spectator->fd, &header, MSG_DONTWAIT | MSG_NOSIGNAL);
+        hub->writes++;
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        hub->bytes += (unsigned long long)sent;
+
+        // Retire what went out; a message cut short stays referenced
+        size_t left = (size_t)sent;
+        for (int i = 0; i < count; i++) {
+            BroadcastMessage* message = messages[i];
+            int first = message == spectator->partial;
+            size_t length = iov[i].iov_len;
+
+            if (left >= length) {
+                left -= length;
+                if (first) {
+                    broadcast_release(hub, spectator->partial);
+                    spectator->partial = NULL;
+                    spectator->offset = 0;
+                } else {
+                    spectator->next_seq = message->seq + 1;
+                }
+                continue;
+            }
+            if (left > 0 || first) {
+                if (first) {
+                    spectator->offset += (int)left;
+                } else {
+                    message->refs++;
+                    spectator->partial = message;
+                    spectator->offset = (int)left;
+                    spectator->next_seq = message->seq + 1;
+                }
+            }
+            break;
+        }
+        if ((size_t)sent < total) {
+            return 1;   // Socket full
+        }
+    }
+}
+
+void broadcast_pump(BroadcastHub* hub) {
+    for (int i = 0; i < hub->count; ) {
+        if (broadcast_send(hub, &hub->spectators[i])) {
+            i++;
+        } else {
+            broadcast_remove(hub, i);
+            hub->dropped++;
+        }
+    }
+}
+
+void broadcast_free(BroadcastHub* hub) {
+    while (hub->count > 0) {
+        broadcast_remove(hub, hub->count - 1);
+    }
+    for (int i = 0; i < BROADCAST_RING; i++) {
+        broadcast_release(hub, hub->ring[i]);
+        hub->ring[i] = NULL;
+    }
+    broadcast_release(hub, hub->keyframe);
+    hub->keyframe = NULL;
+    free(hub->spectators);
+    hub->spectators = NULL;
+    hub->capacity = 0;
+}
+
+// Baseline for the benchmark: format the update for every client into
+// its own backlog...
+void broadcast_copy_each(BroadcastHub* hub, const BroadcastUpdate* update) {
+    for (int i = 0; i < hub->count; i++) {
+        Spectator* spectator = &hub->spectators[i];
+        char text[BROADCAST_MESSAGE];
+        int length = broadcast_encode(update->board, update->line, update->keyframe, text);
+
+        if (spectator->queued + (size_t)length > spectator->queue_capacity) {
+            size_t capacity = spectator->queue_capacity ? spectator->queue_capacity * 2 : 4096;
+            while (capacity < spectator->queued + (size_t)length) {
+                capacity *= 2;
+            }
+            char* queue = (char*)realloc(spectator->queue, capacity);
+            if (!queue) {
+                continue;
+            }
+            spectator->queue = queue;
+            spectator->queue_capacity = capacity;
+        }
+        memcpy(spectator->queue + spectator->queued, text, (size_t)length);
+        spectator->queued += (size_t)length;
+    }
+}
+
+// ...and write as much of it as each socket takes
+void broadcast_flush_copies(BroadcastHub* hub) {
+    for (int i = 0; i < hub->count; i++) {
+        Spectator* spectator = &hub->spectators[i];
+        if (spectator->queued == 0) {
+            continue;
+        }
+        ssize_t sent = send(spectator->fd, spectator->queue, spectator->queued, MSG_DONTWAIT | MSG_NOSIGNAL);
+        hub->writes++;
+        if (sent > 0) {
+            hub->bytes += (unsigned long long)sent;
+            memmove(spectator->queue, spectator->queue + sent, spectator->queued - (size_t)sent);
+            spectator->queued -= (size_t)sent;
+        }
+    }
+}
+
+void broadcast_reader(void* arg) {
+    BroadcastReaders* readers = (BroadcastReaders*)arg;
+    static char buffer[65536];
+    long long next_slow = 0;
+
+    while (!readers->quit) {
+        long long now = get_time_ms();
+        int slow_turn = now >= next_slow;
+        int progress = 0;
+
+        if (slow_turn) {
+            next_slow = now + BROADCAST_SLOW_MS;
+        }
+        for (int i = 0; i < readers->count; i++) {
+            int slow = i % BROADCAST_SLOW_EVERY == BROADCAST_SLOW_EVERY - 1;
+            if (slow && !slow_turn) {
+                continue;
+            }
+            ssize_t got = read(readers->fds[i], buffer, slow ? 1024 : sizeof(buffer));
+            if (got > 0) {
+                readers->bytes += (unsigned long long)got;
+                progress = 1;
+            }
+        }
+        if (!progress) {
+            usleep(1000);
+        }
+    }
+}
+
+// CPU time of the calling thread
+long long thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+// Iteration hook: search progress becomes an update. A live game
+// publishes it at once, the benchmark collects it.
+void broadcast_info(void* context, int depth, int score) {
+    BroadcastGame* game = (BroadcastGame*)context;
+    char line[64];
+
+    snprintf(line, sizeof(line), "info ply %d depth %d score %d", game->ply + 1, depth, score);
+#if defined(UNIVAC) && defined(POSIX)
+    if (game->hub) {
+        char text[BROADCAST_MESSAGE];
+        broadcast_publish(game->hub, text, broadcast_encode(NULL, line, 0, text), 0);
+        broadcast_pump(game->hub);
+        return;
+    }
+#endif
+    if (game->count < game->capacity) {
+        BroadcastUpdate* update = &game->updates[game->count++];
+        update->keyframe = 0;
+        memcpy(update->line, line, sizeof(line));
+    }
+}
+
+// Fan-out benchmark on local socket pairs with TCP-sized send buffers:
+// the same self-play updates go to every spectator, sent in rounds of
+// BROADCAST_BATCH, once with a per-client formatted copy and backlog (the
+// usual way) and once as shared messages with gather writes. Every tenth
+// spectator reads only 1 KB per BROADCAST_SLOW_MS.
+void run_broadcast(ChessState* state, int spectators, int updates) {
+#if defined(UNIVAC) && defined(POSIX)
+    static BroadcastHub hub;
+    static BroadcastReaders readers;
+    BroadcastGame game;
+    int* pairs;
+
+    if (spectators <= 0) {
+        spectators = BROADCAST_SPECTATORS;
+    }
+    if (updates <= 0) {
+        updates = BROADCAST_UPDATES;
+    }
+
+    // Self-play updates: search info per iteration and every move with its board
+    memset(&game, 0, sizeof(game));
+    game.updates = (BroadcastUpdate*)malloc((size_t)updates * sizeof(BroadcastUpdate));
+    pairs = (int*)malloc((size_t)spectators * 2 * sizeof(int));
+    if (!game.updates || !pairs) {
+        printf("Out of memory\n");
+        return;
+    }
+    game.capacity = updates;
+    state->iteration_hook = broadcast_info;
+    state->hook_context = &game;
+    init_chess(state);
+    for (int color = WHITE; game.count < updates; color ^= COLOR_MASK) {
+        int move = game.ply < RECORD_MAX_PLIES ? engine_move(state, color, MAX_DEPTH_PLY0) : -1;
+        if (move < 0) {
+            init_chess(state);
+            game.ply = 0;
+            color = BLACK;  // White moves next
+            continue;
+        }
+        if (game.count < updates) {
+            BroadcastUpdate* update = &game.updates[game.count++];
+            char from_str[3], to_str[3];
+            position_to_algebraic(move & 0xFF, from_str);
+            position_to_algebraic(move >> 8, to_str);
+            memcpy(update->board, state->board, BOARD_SIZE);
+            update->keyframe = 1;
+            snprintf(update->line, sizeof(update->line), "move %d %s%s", ++game.ply, from_str, to_str);
+        }
+    }
+    state->iteration_hook = NULL;
+
+    printf("Broadcast: %d updates to %d spectators (every %dth reads 1 KB per %d ms)\n", updates, spectators,
+           BROADCAST_SLOW_EVERY, BROADCAST_SLOW_MS);
+    printf("mode,cpu_ms,wall_ms,send_calls,mbytes_sent,skipped_updates,buffered_kb\n");
+
+    for (int shared = 0; shared <= 1; shared++) {
+        thread_handle reader;
+        int opened = 0;
+
+        memset(&hub, 0, sizeof(hub));
+        for (; opened < spectators; opened++) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, &pairs[opened * 2]) != 0) {
+                break;
+            }
+            int buffer_size = BROADCAST_SNDBUF;
+            setsockopt(pairs[opened * 2], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+            fcntl(pairs[opened * 2 + 1], F_SETFL, O_NONBLOCK);
+            broadcast_add(&hub, pairs[opened * 2]);
+        }
+        if (opened < spectators) {
+            printf("Only %d socket pairs could be opened\n", opened);
+        }
+        memset(&readers, 0, sizeof(readers));
+        readers.count = opened;
+        readers.fds = (int*)malloc((size_t)(opened > 0 ? opened : 1) * sizeof(int));
+        for (int i = 0; i < opened; i++) {
+            readers.fds[i] = pairs[i * 2 + 1];
+        }
+        int reader_started = thread_start(&reader, broadcast_reader, &readers);
+
+        long long start = get_time_ms();
+        long long cpu = thread_cpu_us();
+        for (int u = 0; u < updates; u++) {
+            const BroadcastUpdate* update = &game.updates[u];
+            int round = u % BROADCAST_BATCH == BROADCAST_BATCH - 1 || u == updates - 1;
+            if (shared) {
+                char text[BROADCAST_MESSAGE];
+                broadcast_publish(&hub, text, broadcast_encode(update->board, update->line, update->keyframe, text),
+                                  update->keyframe);
+                if (round) {
+                    broadcast_pump(&hub);
+                }
+            } else {
+                broadcast_copy_each(&hub, update);
+                if (round) {
+                    broadcast_flush_copies(&hub);
+                }
+            }
+        }
+        cpu = thread_cpu_us() - cpu;
+        long long elapsed = get_time_ms() - start;
+
+        // Memory held for unsent data: all backlogs, or the shared messages
+        size_t buffered = (size_t)hub.live_messages * sizeof(BroadcastMessage);
+        if (!shared) {
+            buffered = 0;
+            for (int i = 0; i < hub.count; i++) {
+                buffered += hub.spectators[i].queued;
+            }
+        }
+        printf("%s,%.1f,%lld,%llu,%.1f,%llu,%zu\n", shared ? "shared" : "per-client", cpu / 1000.0, elapsed,
+               hub.writes, hub.bytes / 1048576.0, hub.skipped, (buffered + 1023) / 1024);
+
+        readers.quit = 1;
+        if (reader_started) {
+            thread_join(reader);
+        }
+        for (int i = 0; i < opened; i++) {
+            close(pairs[i * 2 + 1]);
+        }
+        free(readers.fds);
+        broadcast_free(&hub);
+    }
+    free(pairs);
+    free(game.updates);
+#else
+    (void)state;
+    (void)spectators;
+    (void)updates;
+    printf("Broadcast needs a -DPOSIX build\n");
+#endif
+}
+
+// Stream self-play games to every TCP client of the port (e.g. telnet):
+// each move with its board, search info in between, at one ply per
+// BROADCAST_PLY_MS. 0 games = forever.
+void run_serve(ChessState* state, int port, int games, int plies) {
+#if defined(UNIVAC) && defined(POSIX)
+    static BroadcastHub hub;
+    struct sockaddr_in address;
+    BroadcastGame game;
+    int one = 1;
+
+    if (plies <= 0) {
+        plies = MAX_DEPTH_PLY0 / 2;
+    }
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+    if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        printf("Cannot listen on port %d\n", port);
+        if (listener >= 0) {
+            close(listener);
+        }
+        return;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    printf("Serving games on port %d\n", port);
+    fflush(stdout);
+
+    memset(&hub, 0, sizeof(hub));
+    memset(&game, 0, sizeof(game));
+    game.hub = &hub;
+    state->iteration_hook = broadcast_info;
+    state->hook_context = &game;
+
+    for (int played = 0; games <= 0 || played < games; played++) {
+        char line[64];
+        char text[BROADCAST_MESSAGE];
+        int color = WHITE;
+
+        init_chess(state);
+        clear_search_tables(state);
+        game.ply = 0;
+        snprintf(line, sizeof(line), "game %d", played + 1);
+        broadcast_publish(&hub, text, broadcast_encode(state->board, line, 1, text), 1);
+
+        for (;;) {
+            long long next_ply = get_time_ms() + BROADCAST_PLY_MS;
+            int client;
+
+            while ((client = accept(listener, NULL, NULL)) >= 0) {
+                if (!broadcast_add(&hub, client)) {
+                    close(client);
+                }
+            }
+            while (get_time_ms() < next_ply) {
+                broadcast_pump(&hub);
+                usleep(10000);
+            }
+
+            int move = game.ply < RECORD_MAX_PLIES ? engine_move(state, color, plies * 2) : -1;
+            if (move < 0) {
+                break;
+            }
+            char from_str[3], to_str[3];
+            position_to_algebraic(move & 0xFF, from_str);
+            position_to_algebraic(move >> 8, to_str);
+            snprintf(line, sizeof(line), "move %d %s%s", ++game.ply, from_str, to_str);
+            broadcast_publish(&hub, text, broadcast_encode(state->board, line, 1, text), 1);
+            broadcast_pump(&hub);
+            color ^= COLOR_MASK;
+        }
+        printf("Game %d: %d plies, %d spectators, %llu updates skipped, %llu disconnected\n", played + 1, game.ply,
+               hub.count, hub.skipped, hub.dropped);
+        fflush(stdout);
+    }
+
+    // Let the spectators receive the end of the last game
+    for (long long end = get_time_ms() + BROADCAST_PLY_MS; get_time_ms() < end; usleep(10000)) {
+        broadcast_pump(&hub);
+    }
+    state->iteration_hook = NULL;
+    broadcast_free(&hub);
+    close(listener);
+#else
+    (void)state;
+    (void)port;
+    (void)games;
+    (void)plies;
+    printf("Serving games needs a -DPOSIX build\n");
+#endif
+}
+
+// Open a tree dump and write its header
+TreeDump* tree_open(const char* path) {
+    TreeDump* dump = (TreeDump*)calloc(1, sizeof(TreeDump));
+    TreeFileHeader header;
+
+    if (!dump) {
+        return NULL;
+    }
+    dump->buffer = (TreeRecord*)malloc(TREE_BUFFER * sizeof(TreeRecord));
+    dump->file = fopen(path, "wb");
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TREE_MAGIC, 8);
+    header.version = TREE_VERSION;
+    header.record_size = sizeof(TreeRecord);
+    if (!dump->buffer || !dump->file || fwrite(&header, sizeof(header), 1, dump->file) != 1) {
+        tree_close(dump);
+        return NULL;
+    }
+    return dump;
+}
+
+// Append the record of the node returning now. The buffer is written out
+// before a record is added, never after, so the parent can still fill in
+// the move of the last record.
+void tree_record(ChessState* state, int type, int depth, int alpha, int beta, int score, int moves, int cutoff) {
+    TreeDump* dump = state->tree_dump;
+
+    if (dump->used == TREE_BUFFER) {
+        fwrite(dump->buffer, sizeof(TreeRecord), (size_t)dump->used, dump->file);
+        dump->used = 0;
+    }
+    TreeRecord* record = &dump->buffer[dump->used++];
+    int ply = state->stack_depth >> 1;
+    record->alpha = alpha;
+    record->beta = beta;
+    record->score = score;
+    record->ply = (unsigned char)ply;
+    record->level = (unsigned char)(ply + state->tree_iid);
+    record->type = (unsigned char)type;
+    record->depth = (unsigned char)(depth < 0 ? 0 : depth);
+    record->from = TREE_NO_SQUARE;
+    record->to = TREE_NO_SQUARE;
+    record->moves = (unsigned char)(moves > 255 ? 255 : moves);
+    record->cutoff = (unsigned char)(cutoff < 0 || cutoff > 254 ? 255 : cutoff);
+    dump->records++;
+}
+
+// Called by the parent when a child returns: the last record is the child's
+void tree_set_move(ChessState* state, int from, int to) {
+    TreeDump* dump = state->tree_dump;
+    if (dump->used > 0) {
+        dump->buffer[dump->used - 1].from = (unsigned char)from;
+        dump->buffer[dump->used - 1].to = (unsigned char)to;
+    }
+}
+
+void tree_close(TreeDump* dump) {
+    if (dump->file) {
+        if (dump->used > 0 && dump->buffer) {
+            fwrite(dump->buffer, sizeof(TreeRecord), (size_t)dump->used, dump->file);
+        }
+        fclose(dump->file);
+    }
+    free(dump->buffer);
+    free(dump);
+}
+
+// Cutoff index histogram bucket: 0, 1, 2, 3, 4-7, 8-15, 16-31, 32+
+int tree_cut_bucket(int index) {
+    int bucket = 0;
+    if (index < 4) {
+        return index;
+    }
+    for (bucket = 4; index >= 8 && bucket < TREE_CUT_BUCKETS - 1; bucket++) {
+        index >>= 1;
+    }
+    return bucket;
+}
+
+// Offline analysis of a -tree dump: rebuilds every subtree from the
+// post-order records and reports, per ply, the nodes, how often the
+// first move cut off, the nodes spent on moves tried before the one that
+// cut off, the mean size of the subtree that cut off, and the largest
+// subtree; then the cutoff index histogram and
+// the node types
+void run_tree(const char* path) {
+    static const char* const type_names[TREE_TYPES] = {
+        "exact", "cut", "all", "hash", "mate", "probcut", "aborted"
+    };
+    static const char* const bucket_names[TREE_CUT_BUCKETS] = {
+        "0", "1", "2", "3", "4-7", "8-15", "16-31", "32+"
+    };
+    TreePlyStats plies[256];
+    unsigned long long types[TREE_TYPES] = { 0 };
+    unsigned long long buckets[TREE_CUT_BUCKETS] = { 0 };
+    unsigned long long records = 0, iid_nodes = 0, roots = 0;
+    TreeFileHeader header;
+    int max_ply = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("Cannot open %s\n", path);
+        return;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TREE_MAGIC, 8) != 0
+        || header.version != TREE_VERSION || header.record_size != sizeof(TreeRecord)) {
+        printf("%s is not a tree dump of this version\n", path);
+        fclose(file);
+        return;
+    }
+
+    int capacity = 4096, top = 0;
+    TreeSubtree* stack = (TreeSubtree*)malloc((size_t)capacity * sizeof(TreeSubtree));
+    TreeRecord* batch = (TreeRecord*)malloc(TREE_BUFFER * sizeof(TreeRecord));
+    if (!stack || !batch) {
+        printf("Out of memory\n");
+        free(stack);
+        free(batch);
+        fclose(file);
+        return;
+    }
+    memset(plies, 0, sizeof(plies));
+    printf("iteration,depth,score,nodes\n");
+
+    size_t got;
+    while ((got = fread(batch, sizeof(TreeRecord), TREE_BUFFER, file)) > 0) {
+        for (size_t r = 0; r < got; r++) {
+            const TreeRecord* record = &batch[r];
+            TreePlyStats* stats = &plies[record->ply];
+            unsigned long long size = 1, children = 0, last_child = 0;
+            int have_last = 0;
+
+            // Children are the waiting subtrees of a higher level; the
+            // move that cut off is the last one searched, on top
+            while (top > 0 && stack[top - 1].level > record->level) {
+                const TreeSubtree* child = &stack[--top];
+                size += child->size;
+                if (child->ply == record->ply) {
+                    iid_nodes += child->size;   // IID seeding search of this node
+                    continue;
+                }
+                if (!have_last) {
+                    last_child = child->size;
+                    have_last = 1;
+                } else {
+                    children += child->size;
+                }
+            }
+
+            records++;
+            types[record->type < TREE_TYPES ? record->type : TREE_ABORTED]++;
+            stats->nodes++;
+            max_ply = record->ply > max_ply ? record->ply : max_ply;
+            if (record->type == TREE_CUT && record->cutoff != 255) {
+                stats->cut_nodes++;
+                stats->first_cuts += record->cutoff == 0;
+                stats->cut_index_sum += record->cutoff;
+                stats->wasted += children;
+                stats->cut_move_nodes += have_last ? last_child : 0;
+                buckets[tree_cut_bucket(record->cutoff)]++;
+            }
+            if (record->ply > 0 && size > stats->largest) {
+                stats->largest = size;
+                stats->largest_record = *record;
+            }
+            if (record->level == 0) {
+                printf("%llu,%d,%d,%llu\n", ++roots, record->depth, record->score, size);
+            }
+
+            if (top == capacity) {
+                capacity *= 2;
+                TreeSubtree* grown = (TreeSubtree*)realloc(stack, (size_t)capacity * sizeof(TreeSubtree));
+                if (!grown) {
+                    break;
+                }
+                stack = grown;
+            }
+            stack[top].size = size;
+            stack[top].ply = record->ply;
+            stack[top].level = record->level;
+            top++;
+        }
+    }
+    fclose(file);
+    free(batch);
+    free(stack);
+
+    printf("\nply,nodes,cut_nodes,first_move_cut_pct,mean_cut_index,wasted_nodes,mean_cut_subtree,largest_subtree,"
+           "largest_move,largest_type,largest_window\n");
+    for (int p = 0; p <= max_ply; p++) {
+        const TreePlyStats* stats = &plies[p];
+        char from_str[3] = "--", to_str[3] = "--";
+        if (stats->largest && stats->largest_record.from != TREE_NO_SQUARE) {
+            position_to_algebraic(stats->largest_record.from, from_str);
+            position_to_algebraic(stats->largest_record.to, to_str);
+        }
+        printf("%d,%llu,%llu,%.1f,%.2f,%llu,%.1f,%llu,%s%s,%s,%d:%d\n", p, stats->nodes, stats->cut_nodes,
+               stats->cut_nodes ? 100.0 * stats->first_cuts / stats->cut_nodes : 0.0,
+               stats->cut_nodes ? (double)stats->cut_index_sum / stats->cut_nodes : 0.0, stats->wasted,
+               stats->cut_nodes ? (double)stats->cut_move_nodes / stats->cut_nodes : 0.0, stats->largest,
+               from_str, to_str,
+               stats->largest ? type_names[stats->largest_record.type % TREE_TYPES] : "-",
+               stats->largest_record.alpha, stats->largest_record.beta);
+    }
+
+    printf("\ncutoff_index,nodes\n");
+    for (int b = 0; b < TREE_CUT_BUCKETS; b++) {
+        printf("%s,%llu\n", bucket_names[b], buckets[b]);
+    }
+    printf("\nnode_type,nodes\n");
+    for (int t = 0; t < TREE_TYPES; t++) {
+        printf("%s,%llu\n", type_names[t], types[t]);
     }
+    printf("\n%llu nodes in %llu iterations, %llu in IID seeding searches\n", records, roots, iid_nodes);
 }
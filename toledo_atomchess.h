@@ -16,17 +16,130 @@
 #ifndef TOLEDO_ATOMCHESS_H
 #define TOLEDO_ATOMCHESS_H
 
+#if defined(UNIVAC) && defined(POSIX) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64    // 64-bit off_t for fseeko/ftello on 32-bit hosts
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <stddef.h>
 
 // Platform-specific includes
 #ifndef UNIVAC
 #include <windows.h>
 #include <conio.h>
+#elif defined(POSIX)
+// UNIVAC build hosted on a POSIX system (-DUNIVAC -DPOSIX): threads, monotonic clock
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <ucontext.h>
+#endif
+
+// Board scan kernels are built in several instruction set variants on x86
+// hosts and one is picked at startup from CPUID (override with -cpu)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_DISPATCH
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
 #endif
+#endif
+
+#if defined(CPU_DISPATCH) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Analysis sessions
+#define ANALYSIS_MAX_DEPTH 40       // Plies an idle analysis deepens to
+#define ANALYSIS_SYNC_DEPTH 5       // Per-update depth on builds without threads
+#define ANALYSIS_INFO_MS 250        // Minimum interval between info lines
+
+// Deep search checkpoints
+#define CHECKPOINT_MAGIC "ATOMCKP"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_INTERVAL_MS 60000    // Default time between checkpoints
+#define CHECKPOINT_COST_RATIO 50        // Search at least 50x the last checkpoint's cost (<= 2%)
+
+// Game annotation
+#define MAX_GAME_MOVES 512          // Plies stored per game
+#define ANNOTATE_DEPTH 4            // Default search depth (plies) per position
+#define ANNOTATE_BLUNDER_MARGIN 2   // Pawns lost against the best move to flag "??"
+
+// Compact game records: each move is its rank in a deterministic move
+// list, range coded with adaptive binary models
+#define RECORD_MAGIC "ATOMGR"
+#define RECORD_PROB_BITS 11         // Probability precision of the bit models
+#define RECORD_ADAPT_SHIFT 4        // Adaptation speed (higher = slower)
+#define RECORD_TOP (1u << 24)       // Range coder normalization threshold
+#define RECORD_CONTEXTS 8           // Move count bucket x previous move was a capture
+#define RECORD_CLASSES 9            // Elias-gamma classes of rank + 1 (up to 511)
+#define RECORD_MAX_BYTES 2048       // Largest encoded game
+#define RECORD_GAMES 1000           // Self-play games in the default benchmark
+#define RECORD_MAX_PLIES 200        // Length limit of self-play games
+#define RECORD_DECODE_MS 500        // Repeat decoding for at least this long
+
+// Test suites (EPD with bm/am operations)
+#define SUITE_TIME_MS 10000         // Default time limit per position
+#define SUITE_MAX_MOVES 8           // Moves listed per bm/am operation
+#define SUITE_LINE 512              // Longest EPD line
+#define SUITE_CHECK_NODES 1024      // Main-thread nodes between limit checks
+
+// Out-of-core perft: positions at the split ply are deduplicated on disk
+#define PERFT_MERGE_WAY 64          // Runs merged per pass
+#define PERFT_BATCH 4096            // Unique positions counted per checkpoint
+#define PERFT_STATE_VERSION 1
+
+// Cooperative scheduler: many resumable searches on a few worker threads
+#define SCHED_QUANTUM 4096          // Nodes per time slice
+#define SCHED_STACK (512 * 1024)    // Coroutine stack of an active search (MAX_PLY frames)
+#define SCHED_SESSIONS 1000         // Default synthetic sessions
+#define SCHED_SECONDS 10            // Default load duration
+#define SCHED_PLIES 8               // Default search depth
+#define SCHED_THINK_MS 2000         // Mean human think time between searches
+#define SCHED_MAX_PLIES 200         // Game length before a session starts over
+#define SCHED_PRIORITIES 3          // 0 = most urgent
+#define SCHED_HISTOGRAM_MS 10000    // Latency histogram range (1 ms buckets)
+#define SCHED_CONTROL_MS 100        // Effort controller period
+#define SCHED_QUEUE_HIGH 2          // Ready searches per worker that count as overload
+#define EFFORT_FLOOR 25             // Default lowest effort (percent of the node budget)
+#define EFFORT_MIN_DEPTH 2          // Default plies always completed
+#define EFFORT_KNODES 16            // Default node budget per search at full effort (thousands)
+
+// Spectator broadcast: each update is encoded once into a reference
+// counted message and sent to every spectator with gather writes
+#define BROADCAST_RING 64           // Recent updates kept (power of two)
+#define BROADCAST_MAX_LAG 16        // Updates behind before a spectator skips to the latest board
+#define BROADCAST_MESSAGE 512       // Encoded update, board included
+#define BROADCAST_IOV 16            // Messages per gather write
+#define BROADCAST_SPECTATORS 1000   // Default benchmark spectators
+#define BROADCAST_UPDATES 2000      // Default benchmark updates
+#define BROADCAST_SLOW_EVERY 10     // Every tenth benchmark spectator reads slowly:
+#define BROADCAST_SLOW_MS 20        // 1 KB once per interval
+#define BROADCAST_BATCH 8           // Benchmark updates per send round
+#define BROADCAST_SNDBUF 16384      // Benchmark socket send buffer (a TCP window)
+#define BROADCAST_PLY_MS 500        // Pace of served games
+
+// Search tree dump: one record per play() node, in post-order
+#define TREE_MAGIC "ATOMTREE"
+#define TREE_VERSION 1
+#define TREE_BUFFER 65536           // Records per fwrite()
+#define TREE_NO_SQUARE 0x88         // Move field of the root
+#define TREE_CUT_BUCKETS 8          // Cutoff index histogram: 0, 1, 2, 3, 4-7, 8-15, 16-31, 32+
 
 // Board representation constants
 #define BOARD_SIZE 128          // 0x88 board representation
@@ -86,6 +199,105 @@
 #define KING_CAPTURE_SCORE 78
 #define MAX_CHECKMATE_SCORE (KING_CAPTURE_SCORE * 2)
 #define ILLEGAL_MOVE_SCORE (-127)
+#define INFINITE_SCORE 1000000  // Alpha-beta window bound (beyond any reachable score)
+
+// Search limits
+#define MAX_MOVES 256           // Pseudo-legal moves per position (0x88 upper bound)
+#define MAX_PLY 64              // Maximum search ply (stack_depth / 2)
+
+// Move ordering (history tables are int16, kept within +/-HISTORY_MAX)
+#define HISTORY_MAX 16384
+#define ORDER_TT_MOVE 2000000   // Hash move first
+#define ORDER_CAPTURE 1000000   // Captures first (MVV-LVA added on top)
+#define ORDER_KILLER 900000     // Then killer moves
+#define ORDER_COUNTER 800000    // Then the countermove of the previous move
+#define PIECE_INDEX_COUNT 12    // Piece + color mapped to 0-11 for history tables
+
+// ProbCut defaults (depth in plies, margin in pawns)
+#define PROBCUT_DEPTH 5         // Minimum remaining depth to try ProbCut
+#define PROBCUT_REDUCTION 4     // Depth reduction of the verification search
+#define PROBCUT_MARGIN 2        // Raised beta = beta + margin
+#define SEE_KING_VALUE 100      // King value for static exchange evaluation
+
+// Internal iterative reductions / deepening (nodes without a hash move)
+#define IIR_MODE_OFF 0
+#define IIR_MODE_REDUCE 1       // Search one ply shallower
+#define IIR_MODE_DEEPEN 2       // Seed a hash move with a shallow search first
+#define IIR_DEPTH 4             // Minimum remaining depth (plies)
+#define IID_REDUCTION 2         // Plies removed from the seeding search
+#define HISTORY_BONUS 32        // History bonus per (depth + 1)^2
+
+// Expected node types (root = PV; first child of PV = PV, other children
+// CUT; children of CUT = ALL, of ALL = CUT)
+enum { NODE_PV, NODE_CUT, NODE_ALL };
+
+// SPSA tuning (self-play mini-matches between perturbed parameter sets)
+#define SPSA_DEPTH 5            // Search depth (plies) of tuning games
+#define SPSA_PAIRS 16           // Game pairs per iteration (both colors each)
+#define SPSA_OPENING_PLIES 4    // Random moves that start each pair
+#define SPSA_MAX_PLIES 120      // Adjudicate by material after this
+#define SPSA_ADJUDICATE 3       // Pawns ahead to win an adjudicated game
+#define SPSA_STABILITY 100      // Step size a_k = 1 / (1 + k / SPSA_STABILITY)
+#define SPSA_VERSION 1
+
+// Strength-limited play (levels 1 to SKILL_LEVELS, the top level is full strength)
+#define SKILL_LEVELS 10
+#define SKILL_GAMES 20              // Benchmark games per level against full strength
+#define SKILL_OPENING_PLIES 4       // Random moves that start each pair
+#define SKILL_MAX_PLIES 120         // Adjudicate by material after this
+#define SKILL_ADJUDICATE 3          // Pawns ahead to win an adjudicated game
+
+// Hard move deadline: the clock is read every deadline-nodes nodes
+#define DEADLINE_CHECK_NODES 2048   // Default (most) nodes between clock reads
+#define DEADLINE_FIRST_NODES 256    // Nodes before the first read, which measures the speed
+#define DEADLINE_MIN_NODES 16       // Fewest nodes between reads near the deadline
+#define DEADLINE_RESERVE_US 250     // Default time kept back from the deadline
+
+// Attack maps
+#define ATTACK_DEPTH 4              // Default tree depth (plies) of the benchmark
+#define DEADLINE_MS 5               // Default deadline of the benchmark
+#define DEADLINE_POSITIONS 2000     // Default benchmark positions
+#define DEADLINE_WALK_PLIES 40      // Longest random walk from a bench position
+
+// Memory budget (KB) shared by the search state, history and hash tables.
+// UNIVAC builds default to the minimal-footprint profile.
+#if defined(UNIVAC) && !defined(POSIX)
+#define DEFAULT_MEMORY_KB 64
+#else
+#define DEFAULT_MEMORY_KB 4096
+#endif
+#define CONT_HIST_BUDGET_SHARE 3  // Continuation history only if it fits in 1/3 of the budget
+
+// Threads (Lazy SMP helpers share the transposition table)
+#if !defined(UNIVAC) || defined(POSIX)
+#define MAX_THREADS 64
+#else
+#define MAX_THREADS 1           // No thread support: single search thread
+#endif
+#define SCALING_REPEATS 3       // Runs per thread count in the scaling benchmark
+
+// Asynchronous log: per-thread rings drained by a background writer
+#define LOG_RING_SIZE 1024          // Records per thread (power of two)
+#define LOG_BATCH_BYTES 65536       // Formatted text written per fwrite()
+#define LOG_LINE 128                // Longest formatted record
+
+// Transposition table
+#define TT_BYTES_PER_ENTRY ((unsigned long long)sizeof(TTEntry))
+#define TT_BOUND_UPPER 1
+#define TT_BOUND_LOWER 2
+#define TT_BOUND_EXACT 3
+
+// Transposition table file format
+#define TT_FILE_MAGIC "ATOMTT"
+#define TT_FILE_VERSION 1
+#define TT_IO_CHUNK (1 << 20)   // Bytes per read/write call
+#define TT_REHASH_BATCH 256     // Entries per read when the file size differs
+
+// Shared-memory transposition table (several engine processes, one host)
+#define TT_SHARED_MAGIC "ATOMSHM"
+#define TT_SHARED_VERSION 1
+#define TT_SHARED_WAIT_MS 2000  // How long an attacher waits for the creator
+#define SQ64(sq) ((((sq) >> 4) << 3) | ((sq) & 7))  // 0x88 square to 0-63
 
 // Board dimensions for 0x88
 #define BOARD_ROWS 16           // Including frontier rows
@@ -113,6 +325,58 @@ extern const signed char displacement[24];
 // Movement offset indices
 extern const unsigned char offsets[7];
 
+// Move in the move list (ordering score used by the search only)
+typedef struct {
+    unsigned char from;
+    unsigned char to;
+    int score;
+} Move;
+
+// Transposition table entry. The key is stored xor'ed with the data so
+// torn writes from concurrent searches are detected as a mismatch.
+typedef struct {
+    unsigned long long key;     // Hash ^ data
+    unsigned long long data;    // Packed move, depth, bound and score
+} TTEntry;
+
+typedef struct {
+    TTEntry* entries;
+    unsigned long long mask;    // Entry count - 1 (power of two)
+    void* mapping;              // Copy-on-write file mapping holding entries, if any
+    unsigned long long mapping_size;
+    int shared;                 // Mapping is a named shared-memory segment
+    char shared_name[64];
+} TranspositionTable;
+
+// Shared segment header (64 bytes, entries follow immediately). The
+// creator sizes the segment; later processes adopt its entry count.
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    volatile int ready;         // Set once the creator has cleared the entries
+    volatile int attached;      // Attached processes; the last one out unlinks
+    unsigned int entry_size;
+    unsigned long long entries;
+    unsigned char reserved[32];
+} TTSharedHeader;
+
+// Saved table header (64 bytes, entries follow immediately)
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int entry_size;
+    unsigned long long entries;
+    unsigned long long zobrist_check;   // Detects files written with other keys
+    unsigned char reserved[32];
+} TTFileHeader;
+
+extern TranspositionTable tt;
+extern unsigned long long zobrist_keys[16][BOARD_SIZE];
+extern unsigned long long zobrist_side;
+
+// Continuation history: [previous piece][previous to][piece][to]
+#define CONT_HIST_SIZE (PIECE_INDEX_COUNT * 64 * PIECE_INDEX_COUNT * 64)
+
 // Game state structure
 typedef struct {
     unsigned char board[BOARD_SIZE];    // 0x88 board representation
@@ -130,8 +394,663 @@ typedef struct {
 
     // Random seed (for move selection randomization)
     unsigned int rand_seed;
+
+    // Quiet move ordering tables (per search thread)
+    unsigned short killers[MAX_PLY][2];                 // from | (to << 8), 0 = none
+    unsigned short counter_moves[PIECE_INDEX_COUNT][64]; // Indexed by previous move
+    short history[2][64][64];                           // Butterfly history [color][from][to]
+    short* cont_hist;                                   // Continuation history (CONT_HIST_SIZE)
+
+    // Root moves ordered by the score of the last completed iteration
+    Move root_moves[MAX_MOVES];
+    int root_count;
+    int start_depth;                                    // First iteration (plies), 0 = 1
+
+    // Moves on the current search path, for continuation lookups
+    int ply_piece[MAX_PLY];
+    int ply_to[MAX_PLY];
+    unsigned char node_types[MAX_PLY + 1];              // Expected type of each node on the path (NODE_*)
+
+    // Zobrist hash of the board (side to move is mixed in at probe time)
+    unsigned long long hash;
+
+    // Search control
+    volatile int stop;                                  // Set to abort the search in progress
+    int thread_id;                                      // 0 = main thread, >0 = helper
+    int search_color;                                   // Side to move for helper threads
+    void (*iteration_hook)(void* context, int depth, int score);  // Called after each iteration
+    void* hook_context;
+    struct TreeDump* tree_dump;                         // Node records of this search, if any
+    int tree_iid;                                       // IID searches enclosing the current node
+    void (*yield_hook)(void* context);                  // Called when nodes reaches yield_nodes
+    void* yield_context;
+    unsigned long long yield_nodes;
+    int root_margin;                                    // Root moves this close to the best get exact scores
+    int keep_partial;                                   // On abort, keep the best fully searched root move
+    unsigned long long hash_salt;                       // XORed into search keys; different salts share no entries
+
+    // Search parameters
+    int memory_kb;                                      // Budget for all tables
+    int threads;                                        // Search threads (main + helpers)
+    const char* tt_load_file;                           // Hash table to load at startup
+    const char* tt_save_file;                           // Hash table to save at exit
+    int tt_mmap;                                        // Map loaded tables copy-on-write
+    const char* tt_shared_name;                         // Shared-memory table name, if any
+    int checkpoint_ms;                                  // Time between deep search checkpoints
+    const char* log_file;                               // Asynchronous log, if any
+    const char* tree_file;                              // Search tree dump, if any
+    const char* cpu_kernel;                             // Forced kernel variant, NULL = CPUID
+    int iir_mode;                                       // IIR_MODE_*
+    int iir_depth;
+    int iid_reduction;
+    int history_bonus;
+    int probcut_depth;                                  // 0 disables ProbCut
+    int probcut_reduction;
+    int probcut_margin;
+    int effort_control;                                 // Adapt server search effort to load
+    int effort_floor;
+    int effort_min_depth;
+    int effort_knodes;
+    int skill;                                          // SKILL_LEVELS = full strength
+    int deadline_ms;                                    // Reply deadline of engine_move(), 0 = none
+    int deadline_nodes;                                 // Nodes between clock reads
+    int deadline_reserve_us;                            // Kept back for unwinding and host delays
+
+    // Search statistics
+    unsigned long long nodes;
+    unsigned long long cutoffs;
+    unsigned long long first_move_cutoffs;
+    unsigned long long probcut_cutoffs;
+    unsigned long long tt_hits;
 } ChessState;
 
+// Minimal thread layer: Win32 threads, pthreads on POSIX hosts, and on
+// plain UNIVAC builds a "thread" is simply run to completion by thread_start()
+typedef void (*thread_func)(void* arg);
+#ifndef UNIVAC
+typedef HANDLE thread_handle;
+#elif defined(POSIX)
+typedef pthread_t thread_handle;
+#else
+typedef int thread_handle;
+#endif
+
+#ifndef UNIVAC
+typedef CRITICAL_SECTION mutex_handle;
+#elif defined(POSIX)
+typedef pthread_mutex_t mutex_handle;
+#else
+typedef int mutex_handle;
+#endif
+
+// Atomic add returning the previous value (shared table reference count)
+#ifndef UNIVAC
+#define ATOMIC_FETCH_ADD(ptr, value) InterlockedExchangeAdd((volatile LONG*)(ptr), (value))
+#define MEMORY_BARRIER() MemoryBarrier()
+#else
+#define ATOMIC_FETCH_ADD(ptr, value) __sync_fetch_and_add((ptr), (value))
+#define MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+// 64-bit file offsets (perft run files can pass 2 GB)
+#ifndef UNIVAC
+#define FILE_SEEK(file, offset, origin) _fseeki64((file), (long long)(offset), (origin))
+#define FILE_TELL(file) _ftelli64(file)
+#elif defined(POSIX)
+#define FILE_SEEK(file, offset, origin) fseeko((file), (off_t)(offset), (origin))
+#define FILE_TELL(file) ((long long)ftello(file))
+#else
+#define FILE_SEEK(file, offset, origin) fseek((file), (long)(offset), (origin))
+#define FILE_TELL(file) ((long long)ftell(file))
+#endif
+
+// Board scan kernel: bit mask of the squares holding pieces of one color
+enum { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2, KERNEL_COUNT };
+typedef void (*piece_mask_func)(const unsigned char* board, int color, unsigned long long mask[2]);
+
+extern piece_mask_func piece_mask;
+extern int kernel_variant;
+extern const char* const kernel_names[KERNEL_COUNT];
+
+// Runtime search parameter: a named int field of ChessState. Parameters
+// with an SPSA step are tuned; the step is the initial perturbation.
+typedef struct {
+    const char* name;
+    size_t offset;
+    int min;
+    int max;
+    int spsa_step;                              // 0 = not tuned
+} SearchParam;
+
+extern const SearchParam search_params[];
+extern const int search_param_count;
+
+// One SPSA match worker thread: pairs index, index + workers, ...
+typedef struct {
+    ChessState* state;
+    const int* plus;
+    const int* minus;
+    int pairs;
+    int depth;
+    unsigned int seed;
+    int index;
+    int workers;
+    int result;                                 // Plus wins minus losses
+} SpsaWorker;
+
+// Limits of a skill level. The root moves within margin pawns of the
+// best are candidates; each is seen with up to blur pawns of noise.
+typedef struct {
+    int plies;
+    int nodes;                                  // Node cap, 0 = none
+    int margin;
+    int blur;
+} SkillLevel;
+
+extern const SkillLevel skill_levels[SKILL_LEVELS];
+
+// Moves of one level in the skill benchmark
+typedef struct {
+    int moves;
+    int suboptimal;                             // Moves scored below the search's best
+    unsigned long long nodes;
+    long long us;
+} SkillStats;
+
+// Deadline of one search (yield hook context). The search stops at the
+// clock read after which the next one would come too late.
+typedef struct {
+    ChessState* state;
+    long long deadline;                         // get_time_us() time of the reply
+    long long last_check;
+    unsigned long long last_nodes;
+    long long interval;                         // Time between the last two clock reads
+    int adaptive;                               // 0 = fixed reads, stop once the deadline has passed
+    int expired;
+    void (*saved_hook)(void* context);
+    void* saved_context;
+    unsigned long long saved_nodes;
+} SearchDeadline;
+
+// Deepest iteration a deadline search completed (iteration hook context)
+typedef struct {
+    ChessState* state;
+    int depth;
+    int from;
+    int to;
+} DeadlineProbe;
+
+// Attackers per square, [color >> 3][square], kept up to date by attack_set()
+typedef struct {
+    unsigned char counts[2][BOARD_SIZE];
+} AttackMap;
+
+// Attack map benchmark: whether the map is kept and how the node query is answered
+enum { ATTACK_NONE, ATTACK_MAINTAIN, ATTACK_FULL, ATTACK_INCREMENTAL, ATTACK_ON_DEMAND, ATTACK_METHODS };
+
+typedef struct {
+    AttackMap map;
+    int method;
+    int verify;                                 // Compare with a full computation after each update
+    unsigned long long checksum;                // Sum of the query answers
+    unsigned long long mismatches;
+} AttackWalk;
+
+// Fixed-size log record (56 bytes), formatted only by the writer. Each
+// field is used by the record types noted beside it.
+enum { LOG_ITERATION, LOG_MOVE, LOG_GAME_START, LOG_EFFORT };
+
+typedef struct {
+    unsigned char type;
+    unsigned char thread;
+    unsigned char from;                         // Iteration and move: best or played move
+    unsigned char to;
+    short depth;                                // Iteration
+    short color;                                // Move: side that moved
+    int score;                                  // Iteration
+    int game;                                   // Game start: game number from 1
+    int effort;                                 // Effort: percentage of the full node budget
+    int decision;                               // Effort: 0 = hold, 1 = down, 2 = up
+    int ready;                                  // Effort: searches in the ready queue
+    int late;                                   // Effort: percentage of searches past their deadline
+    unsigned long long nodes;                   // Iteration and move
+    unsigned long long budget;                  // Effort: node budget
+    long long time_ms;                          // Since the log was opened
+} LogRecord;
+
+// Single-producer, single-consumer ring: the owning thread advances head,
+// the writer advances tail. A full ring drops the record and counts it.
+typedef struct {
+    LogRecord records[LOG_RING_SIZE];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    volatile unsigned int dropped;
+    unsigned int reported;                      // Drops already written to the log
+} LogRing;
+
+typedef struct {
+    LogRing rings[MAX_THREADS];
+    FILE* file;
+    thread_handle writer;
+    int threaded;                               // Writer thread running
+    volatile int quit;
+    long long start;
+    char batch[LOG_BATCH_BYTES];
+    int batch_size;
+    unsigned long long written;
+    unsigned long long dropped;
+} AsyncLog;
+
+extern AsyncLog* async_log;
+
+// One game read from PGN plus its per-move annotations
+typedef struct {
+    char fen[128];                              // Starting position, "" = initial
+    int move_count;
+    unsigned char from[MAX_GAME_MOVES];
+    unsigned char to[MAX_GAME_MOVES];
+    unsigned char best_from[MAX_GAME_MOVES];    // Engine's choice in each position
+    unsigned char best_to[MAX_GAME_MOVES];
+    int best_score[MAX_GAME_MOVES];             // Score of the best move
+    int played_score[MAX_GAME_MOVES];           // Score of the move played
+} AnnotatedGame;
+
+// Games shared by the annotation workers
+typedef struct {
+    AnnotatedGame* games;
+    int game_count;
+    volatile int next_game;                     // Next game to hand out
+    int depth;
+    int backward;                               // Walk each game from the last move
+    int independent;                            // Fresh tables for each position
+} AnnotateJob;
+
+typedef struct {
+    AnnotateJob* job;
+    ChessState* state;
+} AnnotateWorker;
+
+// Lazy SMP helpers kept running between searches. Each helper keeps its
+// state and histories; it idles until the generation changes, then
+// searches the position set up for it until the main thread stops it.
+struct HelperPool;
+
+typedef struct {
+    struct HelperPool* pool;
+    int index;                                  // helper_states[index]
+} HelperSlot;
+
+typedef struct HelperPool {
+    thread_handle threads[MAX_THREADS];
+    HelperSlot slots[MAX_THREADS];
+    int started;                                // Helpers running, helper_states[0..started-1]
+    volatile int generation;                    // Bumped to start a search
+    volatile int done[MAX_THREADS];             // Last generation each helper finished
+    volatile int quit;
+} HelperPool;
+
+// Long-running analysis of a position that changes while it is searched.
+// The caller plays moves on its own copy of the game, where they are
+// checked before the new position is queued; the search thread aborts the
+// running iteration, reroots and deepens again with the same tables.
+typedef struct {
+    ChessState* state;                          // Searched by the session thread
+    ChessState* front;                          // The caller's game, for move checks and takebacks
+    int color;                                  // Side to move in the analysed position
+    int front_color;
+    thread_handle thread;
+    int threaded;
+    HelperPool pool;
+    mutex_handle lock;                          // Guards the queued position
+    unsigned char queued_board[BOARD_SIZE];     // Newest position, applied at the next reroot
+    int queued_enp;
+    int queued_color;
+    volatile int pending;                       // A position waiting to be applied
+    volatile int quit;
+    int ply;                                    // Moves played on the front copy, for takebacks
+    unsigned char boards[MAX_GAME_MOVES][BOARD_SIZE];   // Board before each move
+    int enps[MAX_GAME_MOVES];
+    long long reroot_time;                      // When the last update was applied
+    long long last_info;
+    int first_info;                             // Next info line is the first after an update
+} AnalysisSession;
+
+// One test-suite position being searched (iteration hook context)
+typedef struct {
+    ChessState* state;
+    char id[64];
+    int color;
+    int best_count;                             // bm: any of these solves it
+    int avoid_count;                            // am: none of these may be chosen
+    unsigned short best[SUITE_MAX_MOVES];       // from | (to << 8)
+    unsigned short avoid[SUITE_MAX_MOVES];
+    long long start;
+    long long time_limit;
+    unsigned long long node_limit;              // 0 = none
+    int found_depth;                            // Iteration since which the move stayed right, 0 = none
+    long long found_time;
+    unsigned long long found_nodes;
+    int last_from;
+    int last_to;
+    int last_depth;
+} SuitePosition;
+
+// Position at the split ply (nibble-packed board, side, en passant
+// square) and the number of paths that reach it. Sorted by the first
+// PERFT_KEY_BYTES bytes.
+#define PERFT_KEY_BYTES 34
+typedef struct {
+    unsigned char board[32];
+    unsigned char color;
+    unsigned char enp;
+    unsigned char reserved[6];
+    unsigned long long count;
+} PerftRecord;
+
+typedef struct {
+    unsigned long long key;                     // Position hash ^ depth
+    unsigned long long nodes;
+} PerftHashEntry;
+
+// Split phase: records are buffered, sorted, merged and written as runs
+typedef struct {
+    const char* dir;
+    PerftRecord* buffer;
+    int capacity;
+    int used;
+    int runs;
+    unsigned long long positions;               // Paths that reached the split ply
+} PerftSplit;
+
+// Counting phase: workers take positions of the batch in turn
+typedef struct {
+    PerftRecord* records;
+    int count;
+    volatile int next;
+    int depth;
+    unsigned long long hash_entries;            // Per worker, power of two
+} PerftJob;
+
+typedef struct {
+    PerftJob* job;
+    ChessState* state;
+    PerftHashEntry* hash;
+    unsigned long long nodes;
+} PerftWorker;
+
+// Progress, saved as text after every step so a run can be restarted
+enum { PERFT_SPLIT, PERFT_MERGE, PERFT_COUNT, PERFT_DONE };
+typedef struct {
+    int depth;
+    int split;
+    int phase;
+    int first_run;                              // Runs [first_run, next_run) still to merge
+    int next_run;
+    unsigned long long unique;                  // Positions in the final run
+    unsigned long long positions;
+    unsigned long long done;                    // Unique positions counted so far
+    unsigned long long nodes;                   // Leaf nodes counted so far
+} PerftProgress;
+
+// Cooperative scheduler. A session alternates between waiting for its
+// (synthetic) human and a search that runs as a coroutine on whichever
+// worker picks it, yielding every SCHED_QUANTUM nodes.
+enum { SCHED_WAITING, SCHED_READY, SCHED_RUNNING };
+
+typedef struct SchedWorker SchedWorker;
+
+typedef struct {
+    ChessState* state;
+    int priority;
+    int color;                                  // Side the engine plays
+    int ply;                                    // Plies of the current game
+    int status;                                 // SCHED_*
+    int started;                                // Search has had a slice
+    int finished;                               // Search returned
+    int deadline_stop;                          // Search cut short by its deadline
+    long long key;                              // Heap order: wake time or virtual time
+    long long wake;                             // Next request (waiting)
+    long long arrival;                          // Request time of the search
+    long long deadline;
+    long long vtime;                            // Nodes used, weighted by priority
+    unsigned long long search_nodes;            // Node count when the search began
+    unsigned long long budget;                  // Node budget of the search, 0 = none
+    int completed_depth;                        // Last completed iteration
+    int budget_stop;                            // Search cut short by its budget
+    unsigned long long slice_nodes;             // Node count when the slice began
+    SchedWorker* worker;                        // Worker running the current slice
+#ifndef UNIVAC
+    LPVOID fiber;
+#elif defined(POSIX)
+    ucontext_t context;
+    void* stack;
+#endif
+} SchedTask;
+
+typedef struct {
+    mutex_handle lock;
+    SchedTask* tasks;
+    int task_count;
+    SchedTask** ready;                          // Min-heap by virtual time
+    int ready_count;
+    SchedTask** waiting;                        // Min-heap by wake time
+    int waiting_count;
+    void** free_stacks;                         // Stacks of finished searches
+    int free_count;
+    int active;                                 // Searches started and not finished
+    int peak_active;
+    int peak_ready;
+    int depth;
+    int worker_count;
+    long long vclock;                           // Virtual time of the last task picked
+    long long start;
+    long long end;                              // No new searches after this
+    unsigned long long searches;
+    unsigned long long slices;
+    unsigned long long deadline_stops;
+    unsigned long long budget_stops;
+    long long overshoot_ms;                     // Completion past the deadline, summed
+
+    // Effort controller: the node budget follows the load each period
+    const ChessState* params;
+    int effort;                                 // Percent of effort_knodes
+    int min_effort;
+    long long next_control;
+    unsigned int window_searches;               // Searches completed this period
+    unsigned int window_late;                   // ... of which past their deadline
+    unsigned long long effort_sum;              // Effort summed over periods
+    unsigned int periods;
+    unsigned int decreases;
+    unsigned int increases;
+    long long max_latency[SCHED_PRIORITIES];
+    unsigned long long counts[SCHED_PRIORITIES];
+    unsigned int histogram[SCHED_PRIORITIES][SCHED_HISTOGRAM_MS + 1];
+} Scheduler;
+
+struct SchedWorker {
+    Scheduler* sched;
+    int index;
+    SchedTask* current;
+#ifndef UNIVAC
+    LPVOID fiber;
+#elif defined(POSIX)
+    ucontext_t context;
+#endif
+};
+
+// Tree dump record (20 bytes). Records are written when a node returns,
+// so a node's children precede it; its parent is the next record with a
+// lower level. The parent fills in the move that led to the node.
+enum { TREE_EXACT, TREE_CUT, TREE_ALL, TREE_HASH, TREE_MATE, TREE_PROBCUT, TREE_ABORTED, TREE_TYPES };
+typedef struct {
+    int alpha;
+    int beta;
+    int score;
+    unsigned char ply;
+    unsigned char level;                        // ply + enclosing IID searches
+    unsigned char type;                         // TREE_*
+    unsigned char depth;                        // Plies left
+    unsigned char from;                         // Move into the node (TREE_NO_SQUARE at the root)
+    unsigned char to;
+    unsigned char moves;                        // Moves generated (capped at 255)
+    unsigned char cutoff;                       // Index of the move that failed high, 255 = none
+} TreeRecord;
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int record_size;
+    unsigned char reserved[16];
+} TreeFileHeader;
+
+typedef struct TreeDump {
+    FILE* file;
+    TreeRecord* buffer;
+    int used;
+    unsigned long long records;
+} TreeDump;
+
+// Tree analysis: a completed node waiting for its parent
+typedef struct {
+    unsigned long long size;
+    unsigned char ply;
+    unsigned char level;
+} TreeSubtree;
+
+typedef struct {
+    unsigned long long nodes;
+    unsigned long long cut_nodes;
+    unsigned long long first_cuts;
+    unsigned long long cut_index_sum;
+    unsigned long long wasted;                  // Nodes searched before the move that cut off
+    unsigned long long cut_move_nodes;          // Nodes under the moves that cut off
+    unsigned long long largest;
+    TreeRecord largest_record;
+} TreePlyStats;
+
+// Broadcast update, shared by all spectators. The ring holds one
+// reference, the hub's latest board one, and a spectator one while it
+// has sent only part of it.
+typedef struct {
+    int refs;
+    int keyframe;                               // Carries the full board
+    unsigned long long seq;
+    int length;
+    char data[BROADCAST_MESSAGE];
+} BroadcastMessage;
+
+typedef struct {
+    int fd;
+    unsigned long long next_seq;                // Next update to send
+    BroadcastMessage* partial;                  // Update being sent, if any
+    int offset;                                 // Bytes of it already sent
+    unsigned long long skipped;                 // Updates jumped over
+    char* queue;                                // Per-client baseline: own copy of every update
+    size_t queued;
+    size_t queue_capacity;
+} Spectator;
+
+typedef struct {
+    BroadcastMessage* ring[BROADCAST_RING];
+    BroadcastMessage* keyframe;                 // Latest board
+    unsigned long long next_seq;
+    Spectator* spectators;
+    int count;
+    int capacity;
+    unsigned long long writes;                  // Send calls
+    unsigned long long bytes;
+    unsigned long long skipped;
+    unsigned long long dropped;                 // Spectators disconnected
+    int live_messages;                          // Messages allocated
+} BroadcastHub;
+
+// One precomputed benchmark update
+typedef struct {
+    unsigned char board[BOARD_SIZE];
+    int keyframe;
+    char line[64];
+} BroadcastUpdate;
+
+typedef struct {
+    BroadcastHub* hub;
+    BroadcastUpdate* updates;
+    int count;
+    int capacity;
+    int ply;
+} BroadcastGame;
+
+// Benchmark readers: drain the spectators' ends, the slow ones sparingly
+typedef struct {
+    int* fds;
+    int count;
+    volatile int quit;
+    unsigned long long bytes;
+} BroadcastReaders;
+
+// Range coder (LZMA style carry propagation)
+typedef struct {
+    unsigned char* out;
+    int size;
+    int capacity;
+    int overflow;                               // Output did not fit
+    unsigned long long low;
+    unsigned int range;
+    unsigned char cache;
+    long long cache_size;
+} RangeEncoder;
+
+typedef struct {
+    const unsigned char* in;
+    int pos;
+    int size;                                   // Reads past the end see zeros
+    unsigned int range;
+    unsigned int code;
+} RangeDecoder;
+
+// Per-game adaptive model of move ranks
+typedef struct {
+    unsigned short prefix[RECORD_CONTEXTS][RECORD_CLASSES];    // Unary class bits
+    unsigned short suffix[RECORD_CLASSES][RECORD_CLASSES];     // Bits below the class
+} RecordModel;
+
+// Saved iterative deepening state of a deep search (the hash table is
+// snapshotted next to it in <file>.tt0 or <file>.tt1)
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    int color;                                  // Side to move
+    unsigned char board[BOARD_SIZE];            // Position searched
+    int enp;
+    int completed_depth;                        // Plies of the last completed iteration
+    int score;
+    int best_from;
+    int best_to;
+    int pv_length;
+    Move pv[MAX_PLY];
+    int root_count;
+    Move root_moves[MAX_MOVES];                 // Root order and scores
+    unsigned long long nodes;                   // Totals over all runs so far
+    long long elapsed_ms;
+    int tt_slot;                                // Hash table snapshot in <file>.tt<slot>
+} SearchCheckpoint;
+
+typedef struct {
+    ChessState* state;
+    const char* path;
+    int color;
+    long long start;                            // Start of this run
+    long long last_checkpoint;
+    long long last_cost;                        // Time the last checkpoint took
+    long long total_cost;
+    int checkpoints;
+    int completed_depth;                        // Last finished iteration and its score
+    int completed_score;
+    int saved_depth;                            // Iteration in the checkpoint on disk
+    unsigned long long previous_nodes;          // Carried over from earlier runs
+    long long previous_elapsed;
+    int tt_slot;                                // Snapshot resumed from, never overwritten
+} DeepSearch;
+
 // Platform-specific string copy
 #ifdef UNIVAC
 #define SAFE_STRCPY(dest, src, size) do { strncpy(dest, src, (size)-1); (dest)[(size)-1] = '\0'; } while(0)
@@ -147,8 +1066,11 @@ typedef struct {
 void init_chess(ChessState* state);
 void create_board(ChessState* state);
 void setup_board(ChessState* state);
+int load_fen(ChessState* state, const char* fen);
 
 // Display
+#define BOARD_TEXT_BYTES 320        // format_board() output with the terminator
+int format_board(const unsigned char* board, char* out);
 void display_board(const ChessState* state);
 void display_char(char c);
 
@@ -156,9 +1078,20 @@ void display_char(char c);
 int read_key(void);
 int key_to_coord(void);
 
+// CPU feature dispatch
+void piece_mask_scalar(const unsigned char* board, int color, unsigned long long mask[2]);
+void piece_mask_sse2(const unsigned char* board, int color, unsigned long long mask[2]);
+void piece_mask_avx2(const unsigned char* board, int color, unsigned long long mask[2]);
+int cpu_supports_kernel(int variant);
+int select_kernel(const char* name);
+void set_kernel(int variant);
+int pop_square(unsigned long long mask[2]);
+
 // Move generation and validation
-int play(ChessState* state, int origin, int target, int current_color, int* best_score);
+int generate_moves(const ChessState* state, int current_color, Move* moves);
+int play(ChessState* state, int origin, int target, int current_color, int alpha, int beta, int* best_score);
 int play_validate(ChessState* state, int origin, int target, int current_color);
+int move_is_legal(ChessState* state, int from, int to, int color);
 int is_legal_move(ChessState* state, int from, int to, int color);
 
 // Move execution
@@ -179,15 +1112,232 @@ int get_piece_color(unsigned char piece);
 void position_to_algebraic(int pos, char* output);
 
 // AI/Search
+int engine_move(ChessState* state, int color, int depth_limit);
 void computer_move(ChessState* state, int color);
+int search_position(ChessState* state, int color, int depth_limit);
 int evaluate_position(const ChessState* state, int color);
 
+// Hashing and transposition table
+void init_zobrist(void);
+unsigned long long compute_hash(const ChessState* state);
+unsigned long long next_salt(unsigned long long salt);
+int tt_init(unsigned long long entries);
+void tt_free(void);
+void tt_clear(void);
+int tt_attach_shared(const char* name, unsigned long long entries, unsigned long long max_bytes);
+void run_process_scaling(ChessState* state, int max_processes, int depth);
+int tt_save(const char* path);
+int tt_load(const char* path, int use_mmap);
+int tt_command(const char* line, int use_mmap);
+int tt_probe(unsigned long long key, int* move, int* depth, int* bound, int* score);
+void tt_store(unsigned long long key, int move, int depth, int bound, int score);
+
+// Memory budget
+unsigned long long apply_memory_budget(ChessState* state, int memory_kb);
+void report_memory(const ChessState* state, unsigned long long used);
+
+// Threads and parallel search
+int thread_start(thread_handle* thread, thread_func func, void* arg);
+void thread_join(thread_handle thread);
+void mutex_init(mutex_handle* mutex);
+void mutex_lock(mutex_handle* mutex);
+void mutex_unlock(mutex_handle* mutex);
+void mutex_destroy(mutex_handle* mutex);
+int cpu_count(void);
+void helper_search(void* arg);
+int iterative_search(ChessState* state, int color, int depth_limit);
+int parallel_search(ChessState* state, int color, int depth_limit);
+void pool_helper(void* arg);
+void helper_pool_start(HelperPool* pool, const ChessState* state);
+int helper_pool_search(HelperPool* pool, ChessState* state, int color, int depth_limit);
+void helper_pool_stop(HelperPool* pool);
+unsigned long long total_nodes(const ChessState* state);
+double std_dev(double sum, double sum_squares, int count);
+void run_scaling(ChessState* state, int max_threads, int depth, int repeats);
+
+// Static exchange evaluation
+int see_value(unsigned char piece);
+int least_attacker(const ChessState* state, int sq, int color);
+int see(ChessState* state, int from, int to);
+int probcut(ChessState* state, const Move* moves, int count, int current_color, int beta, int depth, int* best_score);
+
+// Attack maps
+void attack_piece(AttackMap* map, const unsigned char* board, int sq, unsigned char piece, int delta);
+void attack_rays(AttackMap* map, const unsigned char* board, int sq, int delta);
+void attack_compute(AttackMap* map, const unsigned char* board);
+void attack_set(AttackMap* map, unsigned char* board, int sq, unsigned char piece);
+int attack_verify(const AttackMap* map, const unsigned char* board);
+int attack_hanging(const ChessState* state, const AttackMap* map, int color, int method);
+unsigned long long attack_walk(ChessState* state, AttackWalk* walk, int color, int depth);
+void run_attacks(ChessState* state, int depth, int verify);
+
+// Move ordering
+void init_search_params(ChessState* state);
+int parse_options(ChessState* state, int argc, char** argv);
+int init_search_tables(ChessState* state);
+void free_search_tables(ChessState* state);
+void clear_search_tables(ChessState* state);
+int piece_index(unsigned char piece);
+void score_moves(const ChessState* state, Move* moves, int count, int current_color, int ply, int tt_move);
+void pick_move(Move* moves, int index, int count);
+void update_quiet_stats(ChessState* state, int current_color, int ply, int depth,
+                        const Move* best, const Move* quiets, int quiet_count);
+
+// Runtime parameters and SPSA tuning
+int find_search_param(const char* name);
+int set_search_param(ChessState* state, const char* name, int value);
+int get_search_param(const ChessState* state, int index);
+void list_search_params(const ChessState* state);
+int spsa_game(ChessState* state, const int* white, const int* black, int depth, unsigned int seed);
+void spsa_worker(void* arg);
+int spsa_match(ChessState* state, const int* plus, const int* minus, int pairs, int depth, unsigned int seed,
+               int workers);
+int spsa_save(const char* path, int iteration, const double* theta);
+int spsa_load(const char* path, int* iteration, double* theta);
+void run_spsa(ChessState* state, const char* path, int iterations, int pairs);
+int material_balance(const ChessState* state);
+
+// Strength-limited play
+void skill_stop(void* context);
+int skill_search(ChessState* state, int color, int depth_limit);
+int skill_game(ChessState* state, int level, int level_color, unsigned int seed, SkillStats* stats);
+void run_skill(ChessState* state, int games);
+
+// Hard move deadline
+void deadline_start(ChessState* state, SearchDeadline* deadline, long long start, long long budget_us);
+void deadline_check(void* context);
+void deadline_end(ChessState* state, SearchDeadline* deadline);
+void deadline_probe(void* context, int depth, int score);
+int deadline_compare(const void* a, const void* b);
+void run_deadline(ChessState* state, int deadline_ms, int plies, int positions);
+
+// Asynchronous log
+int log_open(const char* path);
+LogRecord* log_reserve(int thread, int type);
+void log_publish(int thread);
+void log_push(int thread, int type, int color, int depth, int score, int from, int to, unsigned long long nodes);
+void log_push_game(int thread, int game);
+void log_push_effort(int thread, int effort, int decision, int ready, int late, unsigned long long budget);
+int log_drain(void);
+void log_writer(void* arg);
+void log_poll(void);
+void log_close(void);
+
+// Principal variation and deep search checkpoints
+int extract_pv(ChessState* state, int color, Move* pv, int max_length);
+int save_checkpoint(DeepSearch* deep, int depth, int score);
+int load_checkpoint(const char* path, SearchCheckpoint* checkpoint);
+void deep_search_hook(void* context, int depth, int score);
+void run_deep_search(ChessState* state, const char* path, int depth, const char* fen);
+
+// Analysis sessions
+int session_start(AnalysisSession* session, ChessState* state, int color);
+int session_push_move(AnalysisSession* session, int from, int to);
+void session_queue_position(AnalysisSession* session);
+int session_takeback(AnalysisSession* session);
+void session_stop(AnalysisSession* session);
+void session_apply_updates(AnalysisSession* session);
+void session_info(void* context, int depth, int score);
+void session_thread(void* arg);
+void run_analysis(ChessState* state);
+
+// Game annotation
+int parse_coordinate_move(const char* token, int* from, int* to);
+AnnotatedGame* add_game(AnnotatedGame** games, int* count, int* capacity);
+int read_pgn_games(ChessState* state, const char* path, AnnotatedGame** games);
+int setup_game_position(ChessState* state, const AnnotatedGame* game, int ply);
+void annotate_game(ChessState* state, AnnotatedGame* game, int depth, int backward, int independent);
+void annotate_worker(void* arg);
+long long annotate_games(ChessState* state, AnnotateJob* job);
+void run_annotate(ChessState* state, const char* path, int depth, int backward);
+
+// Compact game records
+int record_move_list(const ChessState* state, int color, Move* moves);
+int encode_game(ChessState* state, const AnnotatedGame* game, unsigned char* out, int capacity);
+int decode_game(ChessState* state, const unsigned char* data, int size, AnnotatedGame* game);
+int self_play_game(ChessState* state, AnnotatedGame* game, int max_plies);
+void run_records(ChessState* state, const char* source, const char* output);
+
+// Perft
+unsigned long long perft(ChessState* state, int color, int depth, PerftHashEntry* hash, unsigned long long mask);
+void perft_pack(const ChessState* state, int color, PerftRecord* record);
+int perft_unpack(ChessState* state, const PerftRecord* record);
+int perft_compare(const void* a, const void* b);
+int perft_flush_run(PerftSplit* split);
+int perft_split(ChessState* state, int color, int plies, PerftSplit* split);
+int perft_merge_runs(const char* dir, int first, int last, int output, unsigned long long* unique);
+void perft_remove_runs(const char* dir, int first, int last);
+void perft_worker(void* arg);
+int perft_save_progress(const char* dir, const PerftProgress* progress);
+int perft_load_progress(const char* dir, PerftProgress* progress);
+void run_perft(ChessState* state, int depth, int split_ply, const char* dir);
+
+// Cooperative scheduler
+void sched_push(SchedTask** heap, int* count, SchedTask* task);
+SchedTask* sched_pop(SchedTask** heap, int* count);
+unsigned long long sched_next_yield(const SchedTask* task);
+void sched_task_yield(void* context);
+void sched_iteration(void* context, int depth, int score);
+void sched_control(Scheduler* sched, int worker, long long now);
+void sched_resume(SchedWorker* worker, SchedTask* task);
+void sched_begin_search(Scheduler* sched, SchedTask* task);
+void sched_end_search(Scheduler* sched, SchedTask* task, long long now);
+void sched_worker(void* arg);
+long long sched_percentile(const Scheduler* sched, int priority, double fraction);
+void run_sched(ChessState* state, int sessions, int seconds, int plies);
+
+// Spectator broadcast
+void broadcast_release(BroadcastHub* hub, BroadcastMessage* message);
+void broadcast_publish(BroadcastHub* hub, const char* text, int length, int keyframe);
+BroadcastMessage* broadcast_message(const BroadcastHub* hub, unsigned long long seq);
+int broadcast_add(BroadcastHub* hub, int fd);
+void broadcast_remove(BroadcastHub* hub, int index);
+int broadcast_send(BroadcastHub* hub, Spectator* spectator);
+void broadcast_pump(BroadcastHub* hub);
+void broadcast_free(BroadcastHub* hub);
+int broadcast_encode(const unsigned char* board, const char* line, int keyframe, char* out);
+void broadcast_copy_each(BroadcastHub* hub, const BroadcastUpdate* update);
+void broadcast_flush_copies(BroadcastHub* hub);
+void broadcast_info(void* context, int depth, int score);
+void broadcast_reader(void* arg);
+#if defined(UNIVAC) && defined(POSIX)
+long long thread_cpu_us(void);
+#endif
+void run_broadcast(ChessState* state, int spectators, int updates);
+void run_serve(ChessState* state, int port, int games, int plies);
+
+// Search tree dump
+TreeDump* tree_open(const char* path);
+void tree_record(ChessState* state, int type, int depth, int alpha, int beta, int score, int moves, int cutoff);
+void tree_set_move(ChessState* state, int from, int to);
+void tree_close(TreeDump* dump);
+int tree_cut_bucket(int index);
+void run_tree(const char* path);
+
+// Test suites
+int parse_san_move(const ChessState* state, int color, const char* token, int* from, int* to);
+int parse_epd(ChessState* state, const char* line, SuitePosition* position);
+void suite_hook(void* context, int depth, int score);
+void suite_yield(void* context);
+void run_suite(ChessState* state, const char* path, int time_ms, unsigned long long node_limit);
+
+// Benchmark
+long long get_time_ms(void);
+long long get_time_us(void);
+void run_bench(ChessState* state, int depth);
+
 // Random number (for move selection)
 unsigned char get_random_byte(ChessState* state);
 
 // Main game loop
 void run_game(ChessState* state);
 
+// Scripted replay (the game loop without a console)
+#define REPLAY_LINE 1024            // Longest script line
+#define REPLAY_TRANSCRIPT 4096      // Transcript characters per game
+int replay_player_move(ChessState* state, int from, int to, int depth_limit, char* transcript, int* length);
+void run_replay(ChessState* state, const char* path, int depth);
+
 // Platform-specific functions
 #ifndef UNIVAC
 void console_setup(void);